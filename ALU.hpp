@@ -1,103 +1,252 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <format>
 #include <stdexcept>
+#include <string>
 
 #include "bus.hpp"
+#include "stats.hpp"
 #include "utils.hpp"
 
-class ALU : public Updatable, public CDBSource {
-    Reg<size_t> reorder_index;
-    Reg<uint32_t> out;
+// 整数功能单元的配置：能执行的指令类别、按 subop 的延迟（周期），以及是否
+// 流水（每周期都能接收新指令）。非流水的单元在结果广播前不接收新指令
+struct ALUConfig {
+    unsigned types;  // typeBit(ExecuteType) 的组合
+    std::array<uint8_t, 8> latency;
+    bool pipelined;
+};
+
+constexpr unsigned integerTypes =
+    typeBit(ALU_T) | typeBit(Shift_T) | typeBit(Branch_T);
+
+// 执行全部整数指令、一个周期出结果，结果广播后才接收下一条（原先的 ALU）
+constexpr ALUConfig fullALU{integerTypes, {1, 1, 1, 1, 1, 1, 1, 1}, false};
+// 只做加减、比较与逻辑运算
+constexpr ALUConfig simpleALU{typeBit(ALU_T), {1, 1, 1, 1, 1, 1, 1, 1}, true};
+constexpr ALUConfig shifter{typeBit(Shift_T), {1, 1, 1, 1, 1, 1, 1, 1}, true};
+// 条件分支的比较与 jal/jalr 的返回地址
+constexpr ALUConfig branchUnit{typeBit(Branch_T), {1, 1, 1, 1, 1, 1, 1, 1},
+                               true};
+
+// CPU 中各 ALU 的配置，可以混用不同的单元
+template <size_t N>
+using ALUPool = std::array<ALUConfig, N>;
+
+// N 个相同配置的单元
+template <size_t N>
+constexpr ALUPool<N> uniformALUs(const ALUConfig &config) {
+    ALUPool<N> result{};
+    for (auto &x : result) {
+        x = config;
+    }
+    return result;
+}
+
+// 各单元能执行的指令类别的并集
+template <size_t N>
+constexpr unsigned poolTypes(const ALUPool<N> &pool) {
+    unsigned types = 0;
+    for (const auto &x : pool) {
+        types |= x.types;
+    }
+    return types;
+}
 
+class ALU : public Updatable, public CDBSource {
    public:
-    Wire<ALUBus> bus;
-    Wire<CommonDataBus> cdb;
-    Wire<bool> clear;
+    // 同时在执行或等待广播的指令数上限
+    static constexpr size_t max_slots = 16;
 
-    CommonDataBus CDBOut() const { return CommonDataBus{reorder_index, out}; }
+   private:
+    ALUConfig config;
+    size_t capacity;
 
-    ALU() {
-        reorder_index <= [&]() -> size_t {
-            if (clear) {
-                return 0;
-            }
+    // 每个槽中的指令、结果与剩余周期，reorder_index 为 0 表示空
+    size_t index_of[max_slots];
+    uint32_t result_of[max_slots];
+    size_t remain_of[max_slots];
+
+    // pull 时锁存，update 时写入
+    ALUBus latched_bus;
+    size_t latched_broadcast;
+    bool latched_clear;
+    SquashBus latched_squash;
+
+    StatCounter op_count;
+    StatCounter busy_count;
+    StatCounter stall_count;
 
-            if (reorder_index != 0) {
-                if (cdb.value().reorder_index == reorder_index) {
-                    return 0;
+    static uint32_t compute(const ALUBus &ab) {
+        switch (ab.subop) {
+            case 0b000:
+                if (ab.variant_flag) {  // sub
+                    return ab.num_A - ab.num_B;
+                } else {  // add
+                    return ab.num_A + ab.num_B;
                 }
-            } else {
-                ALUBus ab = bus;
-                if (ab.reorder_index != 0) {
-                    return ab.reorder_index;
+                break;
+            case 0b001:  // sll
+                return ab.num_A << (ab.num_B & 0b11111);
+                break;
+            case 0b010:  // slt
+                return static_cast<int32_t>(ab.num_A) <
+                       static_cast<int32_t>(ab.num_B);
+                break;
+            case 0b011:  // sltu
+                return ab.num_A < ab.num_B;
+                break;
+            case 0b100:  // xor
+                return ab.num_A ^ ab.num_B;
+                break;
+            case 0b101:
+                if (ab.variant_flag) {  // sra
+                    // C++20 起规定为算数右移
+                    return static_cast<int32_t>(ab.num_A) >>
+                           (ab.num_B & 0b11111);
+                } else {  // srl
+                    return ab.num_A >> (ab.num_B & 0b11111);
                 }
+                break;
+            case 0b110:  // or
+                return ab.num_A | ab.num_B;
+                break;
+            case 0b111:
+                return ab.num_A & ab.num_B;
+                break;
+            default:
+                throw std::runtime_error(
+                    std::format("Unknown ALU operation code 0b{:03b}",
+                                uint8_t(ab.subop)));
+                break;
+        }
+    }
+
+    // 已出结果、本周期要在 CDB 上广播的槽，没有则为 max_slots
+    size_t finished() const {
+        for (size_t i = 0; i < capacity; i++) {
+            if (index_of[i] != 0 && remain_of[i] == 0) {
+                return i;
             }
+        }
+        return max_slots;
+    }
 
-            return reorder_index;
-        };
+    size_t occupied() const {
+        size_t count = 0;
+        for (size_t i = 0; i < capacity; i++) {
+            count += index_of[i] != 0;
+        }
+        return count;
+    }
 
-        out <= [&]() -> uint32_t {
-            if (clear) {
-                return 0;
-            }
+    void init() {
+        for (size_t i = 0; i < max_slots; i++) {
+            index_of[i] = 0;
+            result_of[i] = 0;
+            remain_of[i] = 0;
+        }
+        latched_bus = ALUBus();
+        latched_broadcast = 0;
+        latched_clear = false;
+        latched_squash = SquashBus();
+    }
 
-            ALUBus ab = bus;
-            if (ab.reorder_index != 0 && reorder_index == 0) {
-                switch (ab.subop) {
-                    case 0b000:
-                        if (ab.variant_flag) {  // sub
-                            return ab.num_A - ab.num_B;
-                        } else {  // add
-                            return ab.num_A + ab.num_B;
-                        }
-                        break;
-                    case 0b001:  // sll
-                        return ab.num_A << (ab.num_B & 0b11111);
-                        break;
-                    case 0b010:  // slt
-                        return static_cast<int32_t>(ab.num_A) <
-                               static_cast<int32_t>(ab.num_B);
-                        break;
-                    case 0b011:  // sltu
-                        return ab.num_A < ab.num_B;
-                        break;
-                    case 0b100:  // xor
-                        return ab.num_A ^ ab.num_B;
-                        break;
-                    case 0b101:
-                        if (ab.variant_flag) {  // sra
-                            // C++20 起规定为算数右移
-                            return static_cast<int32_t>(ab.num_A) >>
-                                   (ab.num_B & 0b11111);
-                        } else {  // srl
-                            return ab.num_A >> (ab.num_B & 0b11111);
-                        }
-                        break;
-                    case 0b110:  // or
-                        return ab.num_A | ab.num_B;
-                        break;
-                    case 0b111:
-                        return ab.num_A & ab.num_B;
-                        break;
-                    default:
-                        throw std::runtime_error(
-                            std::format("Unknown ALU operation code 0b{:03b}",
-                                        uint8_t(ab.subop)));
-                        break;
-                }
+   public:
+    Wire<ALUBus> bus;
+    Wire<CommonDataBus> cdb;
+    Wire<bool> clear;
+    Wire<SquashBus> squash;
+
+    ALU() { configure(fullALU); }
+
+    // 设置单元的配置并清空正在执行的指令
+    void configure(const ALUConfig &new_config) {
+        size_t max_latency = 0;
+        for (uint8_t latency : new_config.latency) {
+            if (latency == 0) {
+                throw std::runtime_error("ALU latency must be positive!");
             }
+            max_latency = std::max<size_t>(max_latency, latency);
+        }
+        // 流水单元每周期进一条指令，最慢的指令出结果时最多有
+        // max_latency 条在执行，另留一个槽给等待广播的结果
+        size_t slots = new_config.pipelined ? max_latency + 1 : 1;
+        if (slots > max_slots) {
+            throw std::runtime_error(
+                std::format("ALU latency {} is too long!", max_latency));
+        }
+        config = new_config;
+        capacity = slots;
+        init();
+    }
+
+    const ALUConfig &configuration() const { return config; }
 
-            return out;
-        };
+    CommonDataBus CDBOut() const {
+        size_t slot = finished();
+        return slot == max_slots ? CommonDataBus()
+                                 : CommonDataBus{index_of[slot],
+                                                 result_of[slot], 0};
+    }
+
+    bool is_busy() const { return occupied() == capacity; }
+
+    void registerStats(StatRegistry &registry,
+                       const std::string &prefix) const {
+        registry.add(prefix + ".ops", "operations dispatched to the unit",
+                     op_count);
+        registry.add(prefix + ".busy", "cycles with an operation in flight",
+                     busy_count);
+        registry.add(prefix + ".stall",
+                     "cycles a finished result waited for the CDB",
+                     stall_count);
     }
 
     void pull() {
-        reorder_index.pull();
-        out.pull();
+        latched_bus = bus;
+        latched_clear = clear;
+        latched_squash = squash;
+        CommonDataBus out = CDBOut();
+        bool broadcast = out.reorder_index != 0 &&
+                         cdb.value().reorder_index == out.reorder_index;
+        latched_broadcast = broadcast ? out.reorder_index : 0;
+
+        if (stats_enabled) {
+            op_count += latched_bus.reorder_index != 0;
+            busy_count += occupied() != 0;
+            stall_count += out.reorder_index != 0 && latched_broadcast == 0;
+        }
     }
 
     void update() {
-        reorder_index.update();
-        out.update();
+        for (size_t i = 0; i < capacity; i++) {
+            if (index_of[i] == 0) continue;
+            if (latched_clear || latched_squash.younger(index_of[i]) ||
+                index_of[i] == latched_broadcast) {
+                index_of[i] = 0;
+            } else if (remain_of[i] != 0) {
+                remain_of[i]--;
+            }
+        }
+
+        if (!latched_clear && latched_bus.reorder_index != 0) {
+            size_t slot = 0;
+            while (slot < capacity && index_of[slot] != 0) slot++;
+            if (slot == capacity) {
+                throw std::runtime_error("The requested ALU is busy!");
+            }
+            index_of[slot] = latched_bus.reorder_index;
+            result_of[slot] = compute(latched_bus);
+            remain_of[slot] = config.latency[latched_bus.subop] - 1;
+        }
+    }
+
+    void reset() {
+        init();
+        op_count.reset();
+        busy_count.reset();
+        stall_count.reset();
     }
-};
\ No newline at end of file
+};
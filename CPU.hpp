@@ -2,94 +2,213 @@
 #include <concepts>
 #include <cstddef>
 #include <cstdint>
+#include <format>
+#include <functional>
+#include <istream>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "ALU.hpp"
 #include "ROB.hpp"
 #include "bus.hpp"
+#include "fetch.hpp"
+#include "fusion.hpp"
+#include "mem_dep.hpp"
 #include "memory.hpp"
+#include "muldiv.hpp"
 #include "predictor.hpp"
 #include "regs.hpp"
+#include "reuse_profile.hpp"
 #include "rs.hpp"
+#include "stats.hpp"
+#include "store_buffer.hpp"
+#include "trace.hpp"
 #include "utils.hpp"
 
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB = 4,
+          size_t N_PRF = ROBLength + 32, size_t FetchWidth = 4,
+          size_t N_IQ = 8, size_t N_MRS = 2,
+          typename MulType = MulDivUnit<3, true>, size_t N_MUL = 1,
+          typename DivType = MulDivUnit<32, false>, size_t N_DIV = 1,
+          ALUPool<N_ALU> ALUConfigs = uniformALUs<N_ALU>(fullALU),
+          unsigned Fusion = FuseNone, size_t N_LOOP = 0>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
 class CPU {
-    Reg<uint32_t> PC;
-    Regs regs;
+    static_assert((poolTypes(ALUConfigs) & integerTypes) == integerTypes,
+                  "Every kind of integer instruction needs an ALU");
+
+    Regs<ROBLength> regs;
     ReorderBuffer<ROBLength> rob;
     MemoryType mem;
-    ReservationStation<MemBus> mem_rs[N_MemRS + 1];
+    // 每周期取至多 FetchWidth 条指令，放进容量为 N_IQ 的指令队列；
+    // 循环缓冲可容纳 N_LOOP 条指令，为 0 时不使用
+    FetchUnit<FetchWidth, N_IQ, N_LOOP> fetch;
+    // alus[i] 按 ALUConfigs[i - 1] 配置
     ALU alus[N_ALU + 1];
-    ReservationStation<ALUBus> alu_rs[N_ALU + 1];
+    // 端口 1..N_ALU 接 ALU，端口 N_ALU + 1 + p 接内存读口 p
+    IssueQueue<N_RS, N_ALU + MemoryType::read_ports, ROBLength> rs;
+    // RV32M 指令的乘除法单元与它们单独的发射队列：端口 1..N_MUL 接乘法单元，
+    // 端口 N_MUL + 1 + d 接除法单元 d
+    MulType muls[N_MUL];
+    DivType divs[N_DIV];
+    IssueQueue<N_MRS, N_MUL + N_DIV, ROBLength> mrs;
     PredictorType predictor;
+    // 已提交的 store 按 16 字节的块合并后写回 mem
+    StoreBuffer<N_SB, 4> store_buffer;
+    MemDependencePredictor<ROBLength, MemoryType::read_ports> mdp;
 
     Reg<uint64_t> cycle_time;
 
-    Wire<uint32_t> next_PC;
+    StatCounter cycle_count;
+    StatCounter committed_count;
+    StatCounter flush_count;
+    StatCounter recover_count;
+    StatCounter squashed_count;
+    StatCounter issue_stall_count;
+    StatCounter rename_stall_count;
+    StatCounter store_stall_count;
+    StatCounter fused_count;
+    StatHistogram rob_occupancy;
+
+    CommitTraceWriter *commit_trace;
+    AddressTraceWriter *address_trace;
+    BranchTraceWriter *branch_trace;
+    ReuseProfiler *reuse_profiler;
+
+    Wire<uint32_t> PC;
     Wire<uint32_t> full_instruction;
-    Reg<bool> valid_instruction;
+    // 队头两条指令组成的融合对（只检查 Fusion 中打开的），融合时一起发射
+    Wire<FusionIdiom> fusion;
+    // 存进 ROB 的指令：融合对的第二条，否则为队头指令
+    Wire<typename FetchUnit<FetchWidth, N_IQ, N_LOOP>::Entry> last_entry;
     Wire<RSBus> rs_bus;
     Wire<ExecuteType> execute_type;
     Wire<size_t> rs_index;
     Wire<bool> issue;
+    Wire<RegIssueBus> rename_bus;
 
     const std::vector<Updatable *> updatables;
     const std::vector<CDBSource *> cdb_sources;
 
     void pullAndUpdate();
+    void traceCommit();
+    void emitTrace(const CommitRecord &record);
 
     CommonDataBus CDBSelect() const;
-    size_t MemRSSelect() const;
-    size_t ALURSSelect() const;
 
     RegValueBus regValue(uint8_t index) const;
 
-    void PCInit();
+    void fetchInit();
     void baseWireInit();
     void regInit();
     void robInit();
     void memInit();
+    void storeBufferInit();
     void aluInit();
+    void mulDivInit();
+    void rsInit();
     void predictorInit();
+    void mdpInit();
 
    public:
     CPU();
 
+    // 恢复上电状态（包括清空内存与统计量），之后可以 load 新的程序
+    void reset();
+    void load(std::istream &program);
+
     bool step(uint8_t &ret);
 
     PredictorStatistics predictorStatistics() const;
     MemoryStatistics memoryStatistics() const;
     size_t cycleTime() const;
+    size_t instructionCount() const;
+
+    void registerStats(StatRegistry &registry) const;
+    // 设置提交轨迹的输出，传入 nullptr 关闭
+    void setCommitTrace(CommitTraceWriter *trace);
+    // 设置访存地址轨迹的输出，传入 nullptr 关闭
+    void setAddressTrace(AddressTraceWriter *trace);
+    // 设置分支轨迹的输出，传入 nullptr 关闭
+    void setBranchTrace(BranchTraceWriter *trace);
+    // 设置数据访存的局部性剖析，传入 nullptr 关闭。按提交顺序剖析每条
+    // load/store，与 store 缓冲、访存违例重新执行等无关
+    void setReuseProfiler(ReuseProfiler *profiler);
 };
 
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
-void CPU<PredictorType, MemoryType, ROBLength, N_MemRS, N_ALU>::baseWireInit() {
-    execute_type = LAM(getExecuteType(get_op(full_instruction)));
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::baseWireInit() {
+    fusion = [&]() -> FusionIdiom {
+        if (Fusion == FuseNone || fetch.size() < 2) {
+            return FuseNone;
+        }
+        return fusionOf(full_instruction, fetch.peek(1).instruction, Fusion);
+    };
+    last_entry = LAM(fetch.peek(fusion == FuseNone ? 0 : 1));
+
+    execute_type = [&]() -> ExecuteType {
+        // 融合的 auipc + jalr 算返回地址，比较 + 分支算比较结果，都交给分支单元
+        FusionIdiom idiom = fusion;
+        if (idiom == FuseAuipcJalr || idiom == FuseCompareBranch) {
+            return Branch_T;
+        }
+        return getExecuteType(full_instruction);
+    };
     rs_index = [&]() -> size_t {
         switch (execute_type) {
-            case ALU_T:
-                return ALURSSelect();
-            case Mem_T:
-                return MemRSSelect();
-            default:
+            case None_T:
                 return 0;
+            case Mul_T:
+            case Div_T:
+                return mrs.freeEntry();
+            default:
+                return rs.freeEntry();
         }
     };
 
     issue = [&]() -> bool {
-        return valid_instruction &&
+        return !fetch.empty() &&
                get_opType(get_op(full_instruction)) != OpType::Unknown &&
-               rob.get_index() != 0 &&
-               (execute_type == None_T || rs_index != 0);
+               rob.get_index() != 0 && !rob.squash().flag &&
+               (execute_type == None_T || rs_index != 0) &&
+               (get_rd(full_instruction) == 0 || regs.freeReg() != 0);
+    };
+
+    rename_bus = [&]() -> RegIssueBus {
+        if (!issue) {
+            return RegIssueBus();
+        }
+
+        RegIssueBus ret{};
+        ret.rd = get_rd(full_instruction);
+        ret.reorder_index = rob.get_index();
+        if (ret.rd != 0) {
+            ret.preg = regs.freeReg();
+            ret.prev = regs.rename(ret.rd);
+        }
+        if (get_op(full_instruction) == 0b0110111U) {  // lui
+            ret.ready = true;
+            ret.value = get_imm(full_instruction);
+            if (fusion == FuseLuiAddi) {
+                ret.value += get_imm(last_entry.value().instruction);
+            }
+        }
+        return ret;
     };
 
     rs_bus = [&]() -> RSBus {
@@ -99,6 +218,7 @@ void CPU<PredictorType, MemoryType, ROBLength, N_MemRS, N_ALU>::baseWireInit() {
 
         RSBus ret{};
         ret.reorder_index = rob.get_index();
+        ret.type = execute_type;
 
         auto rs1 = get_rs1(full_instruction);
         auto rs2 = get_rs2(full_instruction);
@@ -195,175 +315,446 @@ void CPU<PredictorType, MemoryType, ROBLength, N_MemRS, N_ALU>::baseWireInit() {
         ret.variant_flag = get_variant_flag(full_instruction);
         ret.imm = imm;
 
+        // 融合的 auipc + jalr 只需算出返回地址，目标在发射时已交给取指
+        if (fusion == FuseAuipcJalr) {
+            ret.vk = 8;
+        }
+
         return ret;
     };
 }
 
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
-void CPU<PredictorType, MemoryType, ROBLength, N_MemRS, N_ALU>::regInit() {
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::regInit() {
     regs.commit_bus = LAM(rob.regCommit());
-    regs.issue_bus = [&]() -> RegIssueBus {
-        if (issue) {
-            return RegIssueBus{get_rd(full_instruction), rob.get_index()};
+    regs.issue_bus = LAM(rename_bus);
+    regs.cdb = LAM(CDBSelect());
+    regs.clear = LAM(rob.clear());
+    regs.squash = LAM(rob.squash());
+    regs.checkpoint = [&]() -> size_t {
+        if (!issue) {
+            return 0;
         }
-        return RegIssueBus();
+        switch (get_op(last_entry.value().instruction)) {
+            case 0b1100011U: /* branch，融合时也包括比较结果写的 rd */
+                return rob.get_index();
+            case 0b0000011U: /* load，违例时连同它一起作废 */
+                return rob.previous(rob.get_index());
+        }
+        return 0;
     };
-    regs.clear = LAM(rob.clear());
 }
 
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
-void CPU<PredictorType, MemoryType, ROBLength, N_MemRS, N_ALU>::PCInit() {
-    next_PC = [&]() -> uint32_t {
-        auto relocate = rob.PCRelocate();
-        uint32_t address = PC;
-        uint32_t offset = 0;
-        if (relocate.flag) {
-            address = relocate.address;
-            offset = relocate.offset;
-        } else if (issue) {
-            offset = 4;
-            switch (get_op(full_instruction)) {
-                case 0b1101111U: /* jal */
-                    offset = get_imm(full_instruction);
-                    break;
-                case 0b1100011U: /* branch */
-                    if (predictor.branch()) {
-                        offset = get_imm(full_instruction);
-                    }
-                    break;
-                case 0b1100111U: /* jalr */
-                    RegValueBus rb = regValue(get_rs1(full_instruction));
-                    if (rb.q == 0) {
-                        address = rb.v;
-                        offset = get_imm(full_instruction);
-                    }
-                    break;
-            }
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::fetchInit() {
+    fetch.redirect = LAM(rob.PCRelocate());
+    fetch.issued = [&]() -> size_t {
+        return issue ? (fusion == FuseNone ? 1 : 2) : 0;
+    };
+    // 取指在 jalr 处停下，它发射时若 rs1 已知则转向目标，否则先按顺序取指，
+    // 预测失败由提交时的检查恢复。与 auipc 融合的 jalr 发射时总能算出目标
+    fetch.resume = [&]() -> PCBus {
+        if (issue && fusion == FuseAuipcJalr) {
+            return PCBus{true, PC + get_imm(full_instruction),
+                         get_imm(last_entry.value().instruction)};
         }
-
-        return (address + offset) & 0xFFFFFFFEU;
+        if (!issue || get_op(full_instruction) != 0b1100111U) {
+            return PCBus();
+        }
+        RegValueBus rb = regValue(get_rs1(full_instruction));
+        if (rb.q == 0) {
+            return PCBus{true, rb.v, get_imm(full_instruction)};
+        }
+        return PCBus{true, PC, 4};
     };
-
-    PC <= LAM(next_PC);
+    fetch.predict_branch = LAM(predictor.branch());
 }
 
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
-void CPU<PredictorType, MemoryType, ROBLength, N_MemRS, N_ALU>::robInit() {
-    rob.PC = LAM(PC);
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::robInit() {
+    rob.PC = LAM(last_entry.value().PC);
     rob.add_instruction = LAM(issue);
-    rob.branched = LAM(predictor.branch());
-    rob.full_instruction = LAM(full_instruction);
+    rob.branched = LAM(last_entry.value().branched);
+    rob.full_instruction = LAM(last_entry.value().instruction);
+    rob.fused_instruction = [&]() -> uint32_t {
+        return fusion == FuseNone ? 0 : uint32_t(full_instruction);
+    };
     rob.cdb = LAM(CDBSelect());
+    rob.issue_bus = LAM(rename_bus);
+    rob.can_store = LAM(store_buffer.canAccept(rob.front().value));
+    rob.replay = LAM(mdp.violation);
 }
 
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
-void CPU<PredictorType, MemoryType, ROBLength, N_MemRS, N_ALU>::memInit() {
-    for (size_t i = 1; i <= N_MemRS; i++) {
-        mem_rs[i].new_instruction = [&, i]() -> RSBus {
-            return (execute_type == Mem_T && rs_index == i) ? rs_bus : RSBus();
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::memInit() {
+    mem.cdb = LAM(CDBSelect());
+    mem.clear = LAM(rob.clear());
+    mem.squash = LAM(rob.squash());
+    mem.write_bus = LAM(store_buffer.writeBack());
+    for (size_t port = 0; port < MemoryType::read_ports; port++) {
+        mem.read_bus[port] = [&, port]() -> MemBus {
+            RSBus rsbus = rs.dispatch(N_ALU + 1 + port);
+            if (rsbus.reorder_index == 0) {
+                return MemBus();
+            }
+
+            MemBus ret{rsbus.reorder_index,
+                       rsbus.subop,
+                       rsbus.vj + rsbus.imm,
+                       0,
+                       false,
+                       rob.getItem(rsbus.reorder_index).PC};
+            ret.forwarded =
+                store_buffer.forward(ret.address, ret.mode, ret.input) ==
+                decltype(store_buffer)::FullForward;
+            return ret;
         };
-        mem_rs[i].cdb = LAM(CDBSelect());
-        mem_rs[i].clear = LAM(rob.clear());
     }
+}
 
-    mem.cdb = LAM(CDBSelect());
-    mem.PC = LAM(next_PC);
-    mem.clear = LAM(rob.clear());
-    mem.write_bus = LAM(rob.store());
-    mem.read_bus = [&]() -> MemBus {
-        return BusSelect<MemBus>(
-            mem_rs, [&](ReservationStation<MemBus> &x) -> MemBus {
-                return x.execute(rob);
-            });
+template <typename PredictorType, typename MemoryType, size_t ROBLength,
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
+    requires(std::derived_from<PredictorType, Predictor> &&
+             std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::storeBufferInit() {
+    store_buffer.store = LAM(rob.store());
+    store_buffer.write_ready =
+        LAM(mem.can_write(store_buffer.nextWrite().address));
+    store_buffer.forwarded = [&]() -> size_t {
+        size_t count = 0;
+        for (size_t port = 0; port < MemoryType::read_ports; port++) {
+            count += mem.read_bus[port].value().forwarded;
+        }
+        return count;
+    };
+
+    // 只有部分字节在 store 缓冲中的 load 要等缓冲写回后再分派
+    rs.load_ready = [&](const RSBus &rsbus) -> bool {
+        uint32_t address = rsbus.vj + rsbus.imm;
+        uint32_t data;
+        if (store_buffer.forward(address, rsbus.subop, data) ==
+            decltype(store_buffer)::PartialForward) {
+            return false;
+        }
+
+        bool wait = mdp.shouldWait(rob.getItem(rsbus.reorder_index).PC);
+        return rob.canLoad(rsbus.reorder_index, address, wait);
     };
 }
 
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
-void CPU<PredictorType, MemoryType, ROBLength, N_MemRS, N_ALU>::aluInit() {
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::aluInit() {
     for (size_t i = 1; i <= N_ALU; i++) {
-        alu_rs[i].new_instruction = [&, i]() -> RSBus {
-            return (execute_type == ALU_T && rs_index == i) ? rs_bus : RSBus();
+        alus[i].configure(ALUConfigs[i - 1]);
+        alus[i].cdb = LAM(CDBSelect());
+        alus[i].clear = LAM(rob.clear());
+        alus[i].squash = LAM(rob.squash());
+        alus[i].bus = [&, i]() -> ALUBus {
+            RSBus rsbus = rs.dispatch(i);
+            return ALUBus{rsbus.reorder_index, rsbus.subop,
+                          rsbus.variant_flag, rsbus.vj, rsbus.vk};
+        };
+    }
+}
+
+template <typename PredictorType, typename MemoryType, size_t ROBLength,
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
+    requires(std::derived_from<PredictorType, Predictor> &&
+             std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::mulDivInit() {
+    auto connect = [&](auto &unit, size_t port) {
+        unit.cdb = LAM(CDBSelect());
+        unit.clear = LAM(rob.clear());
+        unit.squash = LAM(rob.squash());
+        unit.bus = [&, port]() -> ALUBus {
+            RSBus rsbus = mrs.dispatch(port);
+            return ALUBus{rsbus.reorder_index, rsbus.subop,
+                          rsbus.variant_flag, rsbus.vj, rsbus.vk};
+        };
+    };
+    for (size_t i = 0; i < N_MUL; i++) {
+        connect(muls[i], 1 + i);
+    }
+    for (size_t i = 0; i < N_DIV; i++) {
+        connect(divs[i], N_MUL + 1 + i);
+    }
+}
+
+template <typename PredictorType, typename MemoryType, size_t ROBLength,
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
+    requires(std::derived_from<PredictorType, Predictor> &&
+             std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::rsInit() {
+    // rs_index 是 execute_type 对应的发射队列中的空闲表项
+    auto is_muldiv = [&]() {
+        return execute_type == Mul_T || execute_type == Div_T;
+    };
+    rs.new_instruction = LAM(rs_bus);
+    rs.new_index = [&, is_muldiv]() -> size_t {
+        return is_muldiv() ? 0 : rs_index;
+    };
+    rs.cdb = LAM(CDBSelect());
+    rs.clear = LAM(rob.clear());
+    rs.squash = LAM(rob.squash());
+
+    mrs.new_instruction = LAM(rs_bus);
+    mrs.new_index = [&, is_muldiv]() -> size_t {
+        return is_muldiv() ? rs_index : 0;
+    };
+    mrs.cdb = LAM(CDBSelect());
+    mrs.clear = LAM(rob.clear());
+    mrs.squash = LAM(rob.squash());
+    for (size_t i = 0; i < N_MUL; i++) {
+        mrs.port_types[1 + i] = typeBit(Mul_T);
+        mrs.port_ready[1 + i] = [&, i]() { return !muls[i].is_busy(); };
+    }
+    for (size_t i = 0; i < N_DIV; i++) {
+        mrs.port_types[N_MUL + 1 + i] = typeBit(Div_T);
+        mrs.port_ready[N_MUL + 1 + i] = [&, i]() {
+            return !divs[i].is_busy();
         };
-        alu_rs[i].cdb = LAM(CDBSelect());
-        alu_rs[i].clear = LAM(rob.clear());
     }
 
     for (size_t i = 1; i <= N_ALU; i++) {
-        alus[i].cdb = LAM(CDBSelect());
-        alus[i].clear = LAM(rob.clear());
-        alus[i].bus = [&, i]() { return alu_rs[i].execute(rob); };
+        rs.port_types[i] = ALUConfigs[i - 1].types;
+        rs.port_ready[i] = [&, i]() { return !alus[i].is_busy(); };
+    }
+    for (size_t port = 0; port < MemoryType::read_ports; port++) {
+        rs.port_types[N_ALU + 1 + port] = typeBit(Mem_T);
+        rs.port_ready[N_ALU + 1 + port] = [&, port]() {
+            return !mem.is_busy(port);
+        };
     }
 }
 
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
-void CPU<PredictorType, MemoryType, ROBLength, N_MemRS,
-         N_ALU>::predictorInit() {
-    predictor.PC = LAM(PC);
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::predictorInit() {
+    predictor.PC = LAM(fetch.branch_PC);
     predictor.feedback = LAM(rob.predictFeedback());
+    predictor.fetched = LAM(fetch.predicted());
+    predictor.issued = [&]() -> BranchHistoryBus {
+        auto entry = last_entry.value();
+        if (!issue || get_op(entry.instruction) != 0b1100011U) {
+            return BranchHistoryBus();
+        }
+        return BranchHistoryBus{true, entry.PC, entry.branched,
+                                rob.get_index()};
+    };
+    predictor.squash = LAM(rob.squash());
+    predictor.clear = LAM(rob.clear());
 }
 
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
-CPU<PredictorType, MemoryType, ROBLength, N_MemRS, N_ALU>::CPU()
-    : PC(),
-      regs(),
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::mdpInit() {
+    mdp.cdb = LAM(CDBSelect());
+    mdp.allocate = [&]() -> size_t { return issue ? rob.get_index() : 0; };
+    for (size_t port = 0; port < MemoryType::read_ports; port++) {
+        mdp.load[port] = [&, port]() -> MemBus {
+            return mem.read_bus[port];
+        };
+    }
+}
+
+template <typename PredictorType, typename MemoryType, size_t ROBLength,
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
+    requires(std::derived_from<PredictorType, Predictor> &&
+             std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF, FetchWidth,
+    N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs, Fusion,
+    N_LOOP>::CPU()
+    : regs(N_PRF),
       rob(regs),
       mem(),
-      mem_rs(),
+      fetch(mem),
       alus(),
-      alu_rs(),
+      rs(rob),
+      mrs(rob),
+      mdp(rob),
       cycle_time(0),
-      updatables(collectPointer<Updatable>(cycle_time, PC, regs, rob, mem,
-                                           mem_rs, alus, alu_rs, predictor,
-                                           valid_instruction)),
-      cdb_sources(collectPointer<CDBSource>(mem, alus)) {
+      rob_occupancy(ROBLength),
+      commit_trace(nullptr),
+      address_trace(nullptr),
+      branch_trace(nullptr),
+      reuse_profiler(nullptr),
+      updatables(collectPointer<Updatable>(cycle_time, regs, rob, mem, fetch,
+                                           alus, muls, divs, rs, mrs,
+                                           predictor, store_buffer, mdp)),
+      cdb_sources(collectPointer<CDBSource>(mem, alus, muls, divs)) {
     cycle_time <= LAM(cycle_time + 1);
-    full_instruction = LAM(mem.get_instruction());
-    valid_instruction = false;
-    valid_instruction <= [&]() -> bool { return true; };
+    PC = LAM(fetch.front().PC);
+    full_instruction = LAM(fetch.front().instruction);
 
     baseWireInit();
-    PCInit();
+    fetchInit();
     regInit();
     robInit();
     memInit();
+    storeBufferInit();
     aluInit();
+    mulDivInit();
+    rsInit();
     predictorInit();
+    mdpInit();
+}
+
+template <typename PredictorType, typename MemoryType, size_t ROBLength,
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
+    requires(std::derived_from<PredictorType, Predictor> &&
+             std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::reset() {
+    for (auto &x : updatables) {
+        x->reset();
+    }
+    cycle_count.reset();
+    committed_count.reset();
+    flush_count.reset();
+    recover_count.reset();
+    squashed_count.reset();
+    issue_stall_count.reset();
+    rename_stall_count.reset();
+    store_stall_count.reset();
+    fused_count.reset();
+    rob_occupancy.reset();
+    if (reuse_profiler) {
+        reuse_profiler->reset();
+    }
+
+    // 让所有 Wire 的缓存失效
+    wire_time++;
 }
 
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
-bool CPU<PredictorType, MemoryType, ROBLength, N_MemRS, N_ALU>::step(
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::load(
+    std::istream &program) {
+    reset();
+    mem.load(program);
+}
+
+template <typename PredictorType, typename MemoryType, size_t ROBLength,
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
+    requires(std::derived_from<PredictorType, Predictor> &&
+             std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+bool CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::step(
     uint8_t &ret) {
     if (rob.commit() && rob.front().full_instruction == 0x0ff00513U) {
         ret = regs.reg(10);
@@ -374,16 +765,54 @@ bool CPU<PredictorType, MemoryType, ROBLength, N_MemRS, N_ALU>::step(
 }
 
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
-void CPU<PredictorType, MemoryType, ROBLength, N_MemRS,
-         N_ALU>::pullAndUpdate() {
-#ifdef TRACE
-    bool commit = rob.commit();
-    uint32_t commit_PC = rob.front().PC;
-#endif
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::pullAndUpdate() {
+    if (commit_trace || address_trace || branch_trace || reuse_profiler) {
+        traceCommit();
+    }
+    // 融合的表项提交时算作两条指令
+    bool fused_commit = rob.commit() && rob.front().fused != 0;
+    committed_count += rob.commit() + fused_commit;
+    if (stats_enabled) {
+        ++cycle_count;
+        fused_count += fused_commit;
+        flush_count += rob.clear();
+        SquashBus sb = rob.squash();
+        if (sb.flag) {
+            recover_count += !sb.replay;
+            squashed_count += rob.size() - 1 - rob.age(sb.branch);
+        }
+        issue_stall_count += !fetch.empty() && !issue;
+        rename_stall_count += !fetch.empty() &&
+                              get_rd(full_instruction) != 0 &&
+                              regs.freeReg() == 0;
+        ROBItem front = rob.front();
+        store_stall_count += rob.size() != 0 && front.ready &&
+                             front.is_store() && !rob.commit();
+        rob_occupancy.sample(rob.size());
+
+        // 操作数已就绪、本可推测执行却因预测要等待而留在队列中的 load
+        for (size_t i = 1; i <= N_RS; i++) {
+            RSBus rsbus = rs.readyInstruction(i);
+            if (rsbus.type != Mem_T) continue;
+            uint32_t address = rsbus.vj + rsbus.imm;
+            if (mdp.shouldWait(rob.getItem(rsbus.reorder_index).PC) &&
+                !rob.canLoad(rsbus.reorder_index, address, true) &&
+                rob.canLoad(rsbus.reorder_index, address, false)) {
+                mdp.hold(rsbus.reorder_index, address, rsbus.subop);
+            }
+        }
+    }
+
     for (auto &x : updatables) {
         x->pull();
     }
@@ -391,111 +820,374 @@ void CPU<PredictorType, MemoryType, ROBLength, N_MemRS,
     for (auto &x : updatables) {
         x->update();
     }
-#ifdef TRACE
-    if (commit) {
-        std::cout << std::format("Commit PC: 0x{:08X}, regs: ", commit_PC);
-        for (int i = 0; i < 32; i++) {
-            std::cout << std::format("0x{:08X} ", regs.reg(i));
-        }
-        std::cout << std::endl;
-    }
-#endif
 }
 
+// 在提交发生的周期、寄存器堆更新之前调用，此时 regs 恰为提交前的体系结构状态
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
-CommonDataBus
-CPU<PredictorType, MemoryType, ROBLength, N_MemRS, N_ALU>::CDBSelect() const {
-    return BusSelect<CommonDataBus>(cdb_sources,
-                                    [](CDBSource *x) { return x->CDBOut(); });
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::traceCommit() {
+    if (!rob.commit()) {
+        return;
+    }
+
+    ROBItem item = rob.front();
+    RegCommitBus rcb = rob.regCommit();
+
+    // 融合对先补上第一条指令的记录，它写的值按指令重新算出
+    if (item.fused != 0) {
+        CommitRecord first{};
+        first.PC = item.PC - 4;
+        first.instruction = item.fused;
+        first.rd = get_rd(item.fused);
+        switch (get_op(item.fused)) {
+            case 0b0110111U: /* lui */
+                first.value = get_imm(item.fused);
+                break;
+            case 0b0010111U: /* auipc */
+                first.value = first.PC + get_imm(item.fused);
+                break;
+            default: /* slt, sltu, slti, sltiu */
+                first.value = rcb.data;
+                break;
+        }
+        emitTrace(first);
+    }
+
+    CommitRecord record{};
+    record.PC = item.PC;
+    record.instruction = item.full_instruction;
+    record.rd = get_rd(item.full_instruction) == 0 ? 0 : rcb.rd;
+    record.value = record.rd == 0 ? 0 : rcb.data;
+    if (get_op(item.full_instruction) == 0b0000011U) {
+        record.mem_type = CommitRecord::Load;
+        record.mode = item.subop();
+        record.address = regs.reg(item.rs1()) + item.imm();
+    } else if (item.is_store()) {
+        MemBus wb = rob.store();
+        record.mem_type = CommitRecord::Store;
+        record.mode = wb.mode;
+        record.address = wb.address;
+        // 只记下实际写入的字节，sb、sh 不带源寄存器的高位
+        record.data = wb.mode & 0b010   ? wb.input
+                      : wb.mode & 0b001 ? wb.input & 0xFFFFU
+                                        : wb.input & 0xFFU;
+    }
+    emitTrace(record);
 }
 
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
-size_t CPU<PredictorType, MemoryType, ROBLength, N_MemRS, N_ALU>::MemRSSelect()
-    const {
-    for (size_t i = 1; i <= N_MemRS; i++) {
-        if (!mem_rs[i].is_busy()) {
-            return i;
-        }
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::emitTrace(const CommitRecord &record) {
+    if (commit_trace) {
+        commit_trace->commit(record);
+    }
+    if (address_trace) {
+        address_trace->commit(record);
+    }
+    if (branch_trace) {
+        branch_trace->commit(record);
+    }
+    if (reuse_profiler && record.mem_type != CommitRecord::NoMem) {
+        reuse_profiler->access(record.address, record.PC);
     }
-    return 0;
 }
 
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
-size_t CPU<PredictorType, MemoryType, ROBLength, N_MemRS, N_ALU>::ALURSSelect()
-    const {
-    for (size_t i = 1; i <= N_ALU; i++) {
-        if (!alu_rs[i].is_busy()) {
-            return i;
-        }
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+CommonDataBus
+CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF, FetchWidth,
+    N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs, Fusion,
+    N_LOOP>::CDBSelect() const {
+    CommonDataBus cdb = BusSelect<CommonDataBus>(
+        cdb_sources, [](CDBSource *x) { return x->CDBOut(); });
+    // 结果写入的物理寄存器记在 ROB 表项中
+    if (cdb.reorder_index != 0) {
+        cdb.preg = rob.getItem(cdb.reorder_index).preg;
     }
-    return 0;
+    return cdb;
 }
 
-// 如果 reorder 为 0，直接返回寄存器的值；如果 reorder 不为零，则去 rob
-// 里面找该条记录，如果 ready 则返回对应的值，否则返回 reorder
+// 查重命名表得到物理寄存器，如果已经写回（或正在 CDB 上）则返回其值，否则
+// 返回要等待的物理寄存器号
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
-RegValueBus CPU<PredictorType, MemoryType, ROBLength, N_MemRS, N_ALU>::regValue(
-    uint8_t index) const {
-    auto reorder_index = regs.reorder(index);
-    if (reorder_index == 0) {
-        return RegValueBus{0, regs.reg(index)};
-    } else {
-        auto item = rob.getItem(reorder_index);
-        if (item.ready) {
-            return RegValueBus{0, item.value};
-        }
-
-        CommonDataBus cdb_fetched = CDBSelect();
-        if (cdb_fetched.reorder_index == reorder_index) {
-            return RegValueBus{0, cdb_fetched.data};
-        }
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+RegValueBus CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+                FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV,
+                ALUConfigs, Fusion, N_LOOP>::regValue(uint8_t index) const {
+    auto preg = regs.rename(index);
+    if (regs.isReady(preg)) {
+        return RegValueBus{0, regs.value(preg)};
+    }
 
-        return RegValueBus{reorder_index, 0};
+    CommonDataBus cdb_fetched = CDBSelect();
+    if (cdb_fetched.preg == preg) {
+        return RegValueBus{0, cdb_fetched.data};
     }
+
+    return RegValueBus{preg, 0};
 }
 
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
-PredictorStatistics CPU<PredictorType, MemoryType, ROBLength, N_MemRS,
-                        N_ALU>::predictorStatistics() const {
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+PredictorStatistics CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB,
+                        N_PRF, FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType,
+                        N_DIV, ALUConfigs, Fusion,
+                        N_LOOP>::predictorStatistics() const {
     return predictor.predictorStatistics();
 }
 
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
-MemoryStatistics CPU<PredictorType, MemoryType, ROBLength, N_MemRS,
-                        N_ALU>::memoryStatistics() const {
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+MemoryStatistics CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB,
+                     N_PRF, FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType,
+                     N_DIV, ALUConfigs, Fusion,
+                     N_LOOP>::memoryStatistics() const {
     return mem.memoryStatistics();
 }
 
 template <typename PredictorType, typename MemoryType, size_t ROBLength,
-          size_t N_MemRS, size_t N_ALU>
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
     requires(std::derived_from<PredictorType, Predictor> &&
              std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
-             N_MemRS > 0 && N_ALU > 0)
-size_t CPU<PredictorType, MemoryType, ROBLength, N_MemRS, N_ALU>::cycleTime()
-    const {
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+size_t CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+           FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+           Fusion, N_LOOP>::cycleTime() const {
     return cycle_time;
+}
+
+template <typename PredictorType, typename MemoryType, size_t ROBLength,
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
+    requires(std::derived_from<PredictorType, Predictor> &&
+             std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::registerStats(StatRegistry &registry) const {
+    registry.add("cpu.cycles", "simulated cycles", cycle_count);
+    registry.add("cpu.committed", "committed instructions", committed_count);
+    registry.add("cpu.ipc", "committed instructions per cycle", [&]() {
+        return StatRegistry::ratio(committed_count, cycle_count);
+    });
+    registry.add("cpu.flush", "pipeline flushes on jalr misprediction",
+                 flush_count);
+    registry.add("cpu.recover",
+                 "branch mispredictions recovered at execute",
+                 recover_count);
+    registry.add("cpu.squashed",
+                 "ROB entries discarded by branch recovery and load replay",
+                 squashed_count);
+    registry.add("cpu.issue_stall",
+                 "cycles a fetched instruction could not issue",
+                 issue_stall_count);
+    registry.add("cpu.rename_stall",
+                 "cycles issue waited for a free physical register",
+                 rename_stall_count);
+    registry.add("cpu.store_stall",
+                 "cycles a store waited at commit for the store buffer",
+                 store_stall_count);
+    registry.add("cpu.fused", "committed macro-op fused instruction pairs",
+                 fused_count);
+    registry.add("rob.occupancy", "occupied ROB entries per cycle",
+                 rob_occupancy);
+    // 统计名中部件与端口的编号都从 0 开始：alu0 为 alus[1]
+    rs.registerStats(registry, "rs");
+    for (size_t i = 1; i <= N_ALU; i++) {
+        alus[i].registerStats(registry, std::format("alu{}", i - 1));
+    }
+    mrs.registerStats(registry, "mrs");
+    for (size_t i = 0; i < N_MUL; i++) {
+        muls[i].registerStats(registry, std::format("mul{}", i));
+    }
+    for (size_t i = 0; i < N_DIV; i++) {
+        divs[i].registerStats(registry, std::format("div{}", i));
+    }
+    predictor.registerStats(registry, "predictor");
+    mem.registerStats(registry, "mem");
+    fetch.registerStats(registry, "fetch");
+    store_buffer.registerStats(registry, "store_buffer");
+    mdp.registerStats(registry, "mdp");
+
+#ifdef INSTRUMENT
+    // 按部件汇总 Wire/Reg 的求值次数，未归入任何部件的算作 cpu 自身
+    auto per_cycle = [&](size_t count) {
+        return StatRegistry::ratio(count, cycleTime());
+    };
+    auto add_probes = [&](const std::string &name,
+                          std::function<ProbeTotals(void)> totals) {
+        std::string prefix = "instrument." + name;
+        registry.add(prefix + ".wire_lookups", "Wire::value calls per cycle",
+                     [=]() { return per_cycle(totals().wire_lookups); });
+        registry.add(prefix + ".wire_hits",
+                     "Wire::value calls served from cache per cycle", [=]() {
+                         ProbeTotals t = totals();
+                         return per_cycle(t.wire_lookups - t.wire_evaluations);
+                     });
+        registry.add(prefix + ".wire_evaluations",
+                     "Wire functions evaluated per cycle",
+                     [=]() { return per_cycle(totals().wire_evaluations); });
+        registry.add(prefix + ".reg_pulls", "Reg::pull calls per cycle",
+                     [=]() { return per_cycle(totals().reg_pulls); });
+    };
+
+    std::vector<std::pair<const void *, size_t>> parts;
+    auto add_part = [&](const std::string &name, const auto &part) {
+        parts.emplace_back(&part, sizeof(part));
+        add_probes(name, [&part]() { return probeTotals(&part, sizeof(part)); });
+    };
+    add_part("regs", regs);
+    add_part("rob", rob);
+    add_part("mem", mem);
+    add_part("fetch", fetch);
+    add_part("predictor", predictor);
+    add_part("rs", rs);
+    add_part("mrs", mrs);
+    add_part("store_buffer", store_buffer);
+    add_part("mdp", mdp);
+    for (size_t i = 1; i <= N_ALU; i++) {
+        add_part(std::format("alu{}", i - 1), alus[i]);
+    }
+    for (size_t i = 0; i < N_MUL; i++) {
+        add_part(std::format("mul{}", i), muls[i]);
+    }
+    for (size_t i = 0; i < N_DIV; i++) {
+        add_part(std::format("div{}", i), divs[i]);
+    }
+    add_probes("cpu", [this, parts]() {
+        ProbeTotals totals = probeTotals(this, sizeof(*this));
+        for (const auto &[begin, size] : parts) {
+            totals -= probeTotals(begin, size);
+        }
+        return totals;
+    });
+#endif
+}
+
+template <typename PredictorType, typename MemoryType, size_t ROBLength,
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
+    requires(std::derived_from<PredictorType, Predictor> &&
+             std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::setCommitTrace(CommitTraceWriter *trace) {
+    commit_trace = trace;
+}
+
+template <typename PredictorType, typename MemoryType, size_t ROBLength,
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
+    requires(std::derived_from<PredictorType, Predictor> &&
+             std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::setAddressTrace(AddressTraceWriter *trace) {
+    address_trace = trace;
+}
+
+template <typename PredictorType, typename MemoryType, size_t ROBLength,
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
+    requires(std::derived_from<PredictorType, Predictor> &&
+             std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::setBranchTrace(BranchTraceWriter *trace) {
+    branch_trace = trace;
+}
+
+template <typename PredictorType, typename MemoryType, size_t ROBLength,
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
+    requires(std::derived_from<PredictorType, Predictor> &&
+             std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+void CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+         FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+         Fusion, N_LOOP>::setReuseProfiler(ReuseProfiler *profiler) {
+    reuse_profiler = profiler;
+}
+
+template <typename PredictorType, typename MemoryType, size_t ROBLength,
+          size_t N_RS, size_t N_ALU, size_t N_SB, size_t N_PRF,
+          size_t FetchWidth, size_t N_IQ, size_t N_MRS, typename MulType,
+          size_t N_MUL, typename DivType, size_t N_DIV,
+          ALUPool<N_ALU> ALUConfigs, unsigned Fusion, size_t N_LOOP>
+    requires(std::derived_from<PredictorType, Predictor> &&
+             std::derived_from<MemoryType, BaseMemory> && ROBLength > 0 &&
+             N_RS > 0 && N_ALU > 0 && N_SB > 0 && N_PRF > 32 &&
+             N_MRS > 0 && N_MUL > 0 && N_DIV > 0)
+size_t CPU<PredictorType, MemoryType, ROBLength, N_RS, N_ALU, N_SB, N_PRF,
+           FetchWidth, N_IQ, N_MRS, MulType, N_MUL, DivType, N_DIV, ALUConfigs,
+           Fusion, N_LOOP>::instructionCount() const {
+    return committed_count;
 }
\ No newline at end of file
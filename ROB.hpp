@@ -11,20 +11,32 @@
 #include "regs.hpp"
 #include "utils.hpp"
 
+// ROB 表项的只读快照，由 ReorderBuffer 按下标从各字段数组中拼出。
+// 寄存器结果保存在物理寄存器堆中，value 只保存分支的比较结果与 store 的地址
 struct ROBItem {
-    Reg<uint32_t> full_instruction;
-    Reg<bool> ready;
-    Reg<uint32_t> value;
-    Reg<uint32_t> PC;
-    Reg<bool> branched;
-
-    bool is_jalr() const { return get_op(full_instruction) == 0b1100111U; }
+    uint32_t full_instruction;
+    bool ready;
+    uint32_t value;
+    uint32_t PC;
+    bool branched;
+    size_t preg;  // rd 对应的新物理寄存器，0 表示不写寄存器
+    size_t prev;  // rd 原先的物理寄存器，提交后释放
+    // 与 full_instruction 融合的前一条指令，0 表示没有融合。PC 为后一条的
+    uint32_t fused;
+
+    // 融合的 auipc + jalr 在发射时就知道目标，不再是要检查的 jalr
+    bool is_jalr() const {
+        return get_op(full_instruction) == 0b1100111U && fused == 0;
+    }
 
     bool is_branch() const { return get_op(full_instruction) == 0b1100011U; }
 
     bool is_store() const { return get_op(full_instruction) == 0b0100011U; }
 
-    bool is_mispredicted() const {
+    bool is_mispredicted() const { return is_mispredicted(value); }
+
+    // 比较结果为 result 时分支是否预测失败
+    bool is_mispredicted(uint32_t result) const {
         if (!is_branch()) {
             return false;
         }
@@ -32,9 +44,10 @@ struct ROBItem {
         uint8_t subop = get_subop(full_instruction);
 
         bool should_branch =
-            (subop == 0b000 && value == 0) || (subop == 0b001 && value != 0) ||
-            (subop == 0b100 && value) || (subop == 0b101 && !value) ||
-            (subop == 0b110 && value) || (subop == 0b111 && !value);
+            (subop == 0b000 && result == 0) ||
+            (subop == 0b001 && result != 0) || (subop == 0b100 && result) ||
+            (subop == 0b101 && !result) || (subop == 0b110 && result) ||
+            (subop == 0b111 && !result);
 
         return branched != should_branch;
     }
@@ -43,33 +56,113 @@ struct ROBItem {
     uint8_t rs2() const { return get_rs2(full_instruction); }
     uint32_t imm() const { return get_imm(full_instruction); }
     uint8_t subop() const { return get_subop(full_instruction); }
-    uint8_t rd() const { return get_rd(full_instruction); }
+    uint8_t rd() const { return get_rd(fused ? fused : full_instruction); }
 };
 
+// 按字段分开存放的环形缓冲（下标 1..length）。每周期只写入分配、完成的表项，
+// 提交只移动 head，不逐项复制整个缓冲
 template <size_t length = 8>
 class ReorderBuffer : public Updatable {
     Reg<size_t> head;  // 1-based
     Reg<size_t> tail;
-    ROBItem items[length + 1];
 
-    const Regs& regs;
+    uint32_t full_instruction_of[length + 1];
+    bool ready_of[length + 1];
+    uint32_t value_of[length + 1];
+    uint32_t PC_of[length + 1];
+    bool branched_of[length + 1];
+    size_t preg_of[length + 1];
+    size_t prev_of[length + 1];
+    uint32_t fused_of[length + 1];
+
+    // pull 时锁存，update 时写入对应表项
+    struct Allocation {
+        size_t index;  // 0 表示本周期没有分配
+        uint32_t full_instruction;
+        uint32_t PC;
+        bool branched;
+        size_t preg;
+        size_t prev;
+        uint32_t fused;
+    };
+    Allocation latched_allocation;
+    CommonDataBus latched_cdb;
+
+    const Regs<length>& regs;
+
+    // 分支的比较结果在 CDB 上广播时即检查预测，失败则作废比它新的表项；
+    // 访存违例时作废违例的 load 及比它新的表项
+    Wire<SquashBus> squash_bus;
 
     size_t index_inc(size_t index) const {
         return index == length ? 1 : index + 1;
     }
 
+    bool is_store(size_t index) const {
+        return get_op(full_instruction_of[index]) == 0b0100011U;
+    }
+
+    ROBItem item(size_t index) const {
+        return ROBItem{full_instruction_of[index], ready_of[index],
+                       value_of[index],            PC_of[index],
+                       branched_of[index],         preg_of[index],
+                       prev_of[index],             fused_of[index]};
+    }
+
+    void init() {
+        head.reset(1);
+        tail.reset(1);
+        for (size_t i = 0; i <= length; i++) {
+            full_instruction_of[i] = 0;
+            ready_of[i] = false;
+            value_of[i] = 0;
+            PC_of[i] = 0;
+            branched_of[i] = false;
+            preg_of[i] = 0;
+            prev_of[i] = 0;
+            fused_of[i] = 0;
+        }
+        latched_allocation = Allocation();
+        latched_cdb = CommonDataBus();
+    }
+
    public:
-    Wire<CommonDataBus> cdb;
+    // canLoad 也要读本周期在 CDB 上解析的 store 地址
+    mutable Wire<CommonDataBus> cdb;
     Wire<bool> add_instruction;
     Wire<bool> branched;
     Wire<uint32_t> full_instruction;
+    Wire<uint32_t> fused_instruction;  // 融合对的第一条指令，0 表示没有融合
     Wire<uint32_t> PC;
+    Wire<RegIssueBus> issue_bus;  // 发射指令的重命名结果
+    // store 缓冲能否接收队头的 store，commit() 等 const 查询也要读它
+    mutable Wire<bool> can_store;
+    Wire<size_t> replay;  // 要重新执行的 load 的下标，0 表示没有
 
-    ReorderBuffer(const Regs& regs) : regs(regs) {
+    ReorderBuffer(const Regs<length>& regs) : regs(regs) {
         static_assert(length > 1,
                       "The reorder buffer needs at least two elements long!");
-        head = 1;
-        tail = 1;
+        init();
+        squash_bus = [&]() -> SquashBus {
+            if (clear()) {
+                return SquashBus();
+            }
+
+            // CDB 每周期只广播一个结果，分支与解析地址的 store 不会同时出现
+            CommonDataBus local_cdb = cdb;
+            if (local_cdb.reorder_index != 0 &&
+                item(local_cdb.reorder_index)
+                    .is_mispredicted(local_cdb.data)) {
+                return SquashBus{true, head, local_cdb.reorder_index, length,
+                                 false};
+            }
+
+            size_t load = replay;
+            if (load != 0) {
+                return SquashBus{true, head, previous(load), length, true};
+            }
+            return SquashBus();
+        };
         head <= [&]() -> size_t {
             if (clear()) {
                 return 1;
@@ -86,6 +179,11 @@ class ReorderBuffer : public Updatable {
                 return 1;
             }
 
+            SquashBus sb = squash_bus;
+            if (sb.flag) {
+                return index_inc(sb.branch);
+            }
+
             if (add_instruction) {
                 auto new_tail = index_inc(tail);
                 if (new_tail == head) {
@@ -96,55 +194,6 @@ class ReorderBuffer : public Updatable {
             }
             return tail;
         };
-
-        auto need_update = [&](size_t index) {
-            return !clear() && add_instruction && tail == index;
-        };
-
-        // 更新每个 item
-        for (size_t i = 1; i <= length; i++) {
-            items[i].full_instruction <= [&, i, need_update]() -> uint32_t {
-                if (need_update(i)) {
-                    return full_instruction;
-                }
-                return items[i].full_instruction;
-            };
-            items[i].ready <= [&, i, need_update]() -> bool {
-                if (need_update(i)) {
-                    return get_op(full_instruction) ==
-                           0b0110111U;  // lui 指令已经 ready 了
-                }
-
-                if (cdb.value().reorder_index == i) {
-                    return true;
-                }
-
-                return items[i].ready;
-            };
-            items[i].PC <= [&, i, need_update]() -> uint32_t {
-                if (need_update(i)) {
-                    return PC;
-                }
-                return items[i].PC;
-            };
-            items[i].branched <= [&, i, need_update]() -> bool {
-                if (need_update(i)) {
-                    return branched;
-                }
-                return items[i].branched;
-            };
-            items[i].value <= [&, i, need_update]() -> uint32_t {
-                if (need_update(i) && get_op(full_instruction) == 0b0110111U) {
-                    return get_imm(full_instruction);
-                }
-
-                CommonDataBus local_cdb = cdb;
-                if (local_cdb.reorder_index == i) {
-                    return local_cdb.data;
-                }
-                return items[i].value;
-            };
-        }
     }
 
     // 返回 0 说明 ROB 已满
@@ -153,24 +202,44 @@ class ReorderBuffer : public Updatable {
         return next == head ? 0 : tail;
     }
 
+    size_t previous(size_t index) const {
+        return index == 1 ? length : index - 1;
+    }
+
+    // 表项距队头的距离，越小越老
+    size_t age(size_t index) const {
+        return index >= head ? index - head : index + length - head;
+    }
+
+    // 当前占用的表项数
+    size_t size() const {
+        return tail >= head ? tail - head : tail + length - head;
+    }
+
     bool commit() const {
         if (head == tail) {
             return false;
         }
-        if (!items[head].ready) {
+        if (!ready_of[head]) {
             return false;
         }
-        return true;
+        return !is_store(head) || can_store;
     }
 
+    // 只有 jalr 在提交时才发现预测失败，分支已在执行时恢复
     bool clear() const {
         if (commit()) {
-            return jalr_mispredicted() || items[head].is_mispredicted();
+            return jalr_mispredicted();
         }
         return false;
     }
 
-    bool canLoad(size_t query_index, uint32_t load_address) const {
+    SquashBus squash() { return squash_bus; }
+
+    // query_index 处的 load 能否分派：更老的 store 中不能有地址重叠的；
+    // wait 为 false 时可以越过地址未知的 store 推测执行
+    bool canLoad(size_t query_index, uint32_t load_address,
+                 bool wait = true) const {
         auto overlap = [](uint32_t address1, uint32_t address2) {
             if (address1 < address2) {
                 return address2 - address1 < 4;
@@ -179,11 +248,16 @@ class ReorderBuffer : public Updatable {
             }
         };
 
+        CommonDataBus local_cdb = cdb;
         size_t current = head;
         while (current != query_index) {
-            const auto& item = items[current];
-            if (item.is_store()) {
-                if (!item.ready || overlap(load_address, item.value)) {
+            if (is_store(current)) {
+                // 地址在本周期的 CDB 上广播的 store 视为已知
+                bool known = ready_of[current] ||
+                             local_cdb.reorder_index == current;
+                uint32_t address = ready_of[current] ? value_of[current]
+                                                     : local_cdb.data;
+                if (known ? overlap(load_address, address) : wait) {
                     return false;
                 }
             }
@@ -193,25 +267,43 @@ class ReorderBuffer : public Updatable {
         return true;
     }
 
-    PCBus PCRelocate() const {
-        if (commit()) {
-            // jalr 指令和 b 指令
-            if (jalr_mispredicted()) {
-                return PCBus{true, regs.reg(items[head].rs1()),
-                             items[head].imm()};
+    // 比 query_index 更老的 store 是否都已知地址
+    bool storesResolved(size_t query_index) const {
+        CommonDataBus local_cdb = cdb;
+        for (size_t current = head; current != query_index;
+             current = index_inc(current)) {
+            if (is_store(current) && !ready_of[current] &&
+                local_cdb.reorder_index != current) {
+                return false;
             }
+        }
+        return true;
+    }
 
-            if (items[head].is_mispredicted()) {
-                return PCBus{true, items[head].PC,
-                             items[head].branched ? 4U : items[head].imm()};
-            }
+    PCBus PCRelocate() {
+        // 提交时预测失败的 jalr
+        if (clear()) {
+            ROBItem front_item = item(head);
+            return PCBus{true, regs.reg(front_item.rs1()), front_item.imm()};
+        }
+
+        // 访存违例时从违例的 load 重新取指，执行时预测失败的分支转向另一侧
+        SquashBus sb = squash_bus;
+        if (sb.replay) {
+            return PCBus{true, PC_of[index_inc(sb.branch)], 0};
+        }
+        if (sb.flag) {
+            ROBItem branch_item = item(sb.branch);
+            return PCBus{true, branch_item.PC,
+                         branch_item.branched ? 4U : branch_item.imm()};
         }
 
         return PCBus();
     }
 
     bool jalr_mispredicted() const {
-        if (!items[head].is_jalr()) {
+        ROBItem front_item = item(head);
+        if (!front_item.is_jalr()) {
             return false;
         }
 
@@ -220,40 +312,43 @@ class ReorderBuffer : public Updatable {
             return true;
         }
 
-        uint32_t jaled_PC = items[head_next].PC;
-        uint32_t expected_PC = regs.reg(items[head].rs1()) + items[head].imm();
+        uint32_t jaled_PC = PC_of[head_next];
+        uint32_t expected_PC = regs.reg(front_item.rs1()) + front_item.imm();
 
         return jaled_PC != expected_PC;
     }
 
     MemBus store() const {
-        if (commit() && !clear()) {
-            if (items[head].is_store()) {
-                return MemBus{head, items[head].subop(), items[head].value,
-                              regs.reg(items[head].rs2())};
-            }
+        if (commit() && !clear() && is_store(head)) {
+            ROBItem front_item = item(head);
+            return MemBus{head, front_item.subop(), front_item.value,
+                          regs.reg(front_item.rs2()), false, 0};
         }
         return MemBus();
     }
 
+    // 提交时预测失败的 jalr 也要写回返回地址
     RegCommitBus regCommit() const {
-        if (commit() && !clear()) {
-            return RegCommitBus{head, items[head].rd(), items[head].value};
+        if (commit()) {
+            ROBItem front_item = item(head);
+            return RegCommitBus{head, front_item.rd(),
+                                regs.value(front_item.preg), front_item.preg,
+                                front_item.prev};
         }
         return RegCommitBus();
     }
 
     PredictFeedbackBus predictFeedback() const {
         if (commit()) {
-            if (items[head].is_branch()) {
+            ROBItem front_item = item(head);
+            if (front_item.is_branch()) {
                 return PredictFeedbackBus{
-                    PredictFeedbackBus::Branch, items[head].branched,
-                    items[head].is_mispredicted(), items[head].PC};
+                    PredictFeedbackBus::Branch, front_item.branched,
+                    front_item.is_mispredicted(), front_item.PC};
             }
-            if (items[head].is_jalr()) {
+            if (front_item.is_jalr()) {
                 return PredictFeedbackBus{PredictFeedbackBus::Jalr, 0,
-                                          jalr_mispredicted(),
-                                          items[head].PC};
+                                          jalr_mispredicted(), front_item.PC};
             }
         }
 
@@ -261,38 +356,59 @@ class ReorderBuffer : public Updatable {
     }
 
     void pull() {
+        latched_allocation = Allocation();
+        if (!clear() && add_instruction) {
+            RegIssueBus ib = issue_bus;
+            latched_allocation =
+                Allocation{tail,     full_instruction, PC,
+                           branched, ib.preg,          ib.prev,
+                           fused_instruction};
+        }
+        latched_cdb = cdb;
+
         head.pull();
         tail.pull();
-
-        for (auto& item : items) {
-            item.full_instruction.pull();
-            item.ready.pull();
-            item.PC.pull();
-            item.value.pull();
-            item.branched.pull();
-        }
     }
 
     void update() {
+        // 完成：CDB 上的结果写回对应表项，融合的比较与分支既写寄存器也要留下
+        // 比较结果
+        size_t done = latched_cdb.reorder_index;
+        if (done != 0) {
+            ready_of[done] = true;
+            if (latched_cdb.preg == 0 || fused_of[done] != 0) {
+                value_of[done] = latched_cdb.data;
+            }
+        }
+
+        // 分配：新指令写入队尾表项，lui 与融合的 lui + addi 已经 ready 了
+        const Allocation& a = latched_allocation;
+        if (a.index != 0) {
+            full_instruction_of[a.index] = a.full_instruction;
+            ready_of[a.index] = get_op(a.full_instruction) == 0b0110111U ||
+                                get_op(a.fused) == 0b0110111U;
+            value_of[a.index] = 0;
+            PC_of[a.index] = a.PC;
+            branched_of[a.index] = a.branched;
+            preg_of[a.index] = a.preg;
+            prev_of[a.index] = a.prev;
+            fused_of[a.index] = a.fused;
+        }
+
         head.update();
         tail.update();
-        for (auto& item : items) {
-            item.full_instruction.update();
-            item.ready.update();
-            item.PC.update();
-            item.value.update();
-            item.branched.update();
-        }
     }
 
-    const ROBItem& front() const { return items[head]; }
+    void reset() { init(); }
+
+    ROBItem front() const { return item(head); }
 
-    const ROBItem& getItem(size_t index) const {
+    ROBItem getItem(size_t index) const {
         if (index == 0 || index > length) {
             throw std::out_of_range(std::format(
                 "Accessing the {}th item out of {}!\n", index, length));
         }
 
-        return items[index];
+        return item(index);
     }
-};
\ No newline at end of file
+};
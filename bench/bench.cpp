@@ -0,0 +1,273 @@
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CPU.hpp"
+#include "predictor.hpp"
+#include "utils.hpp"
+
+#ifndef BENCH_WORKLOAD_DIR
+#define BENCH_WORKLOAD_DIR "bench/workloads"
+#endif
+
+// 仿真器自身的性能基准：在几种标准配置下运行自带的 RV32I 负载，
+// 以 CSV 输出宿主机上的仿真速度；--baseline 时与保存的结果比较并标出退步
+
+struct Workload {
+    const char *name;
+    uint8_t expected;
+};
+
+const Workload workloads[] = {
+    {"pointer_chase", 104}, {"matrix_multiply", 184}, {"branchy_sort", 8},
+    {"memcpy", 224},        {"recursive_calls", 219}, {"mul_div", 140},
+};
+
+struct BenchResult {
+    uint8_t ret;
+    uint64_t cycles;
+    uint64_t instructions;
+    double construct_seconds;
+    double run_seconds;
+    long peak_rss_kb;
+};
+
+template <typename CPUType>
+BenchResult runWorkload(const std::string &path) {
+    std::ifstream program(path);
+    if (!program) {
+        throw std::runtime_error(std::format("Cannot open {}!", path));
+    }
+
+    BenchResult result{};
+    auto start = std::chrono::steady_clock::now();
+    CPUType cpu;
+    cpu.load(program);
+    auto constructed = std::chrono::steady_clock::now();
+    while (!cpu.step(result.ret)) {
+        wire_time++;
+    }
+    auto finished = std::chrono::steady_clock::now();
+
+    result.cycles = cpu.cycleTime();
+    result.instructions = cpu.instructionCount();
+    result.construct_seconds =
+        std::chrono::duration<double>(constructed - start).count();
+    result.run_seconds =
+        std::chrono::duration<double>(finished - constructed).count();
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    result.peak_rss_kb = usage.ru_maxrss;
+    return result;
+}
+
+struct Config {
+    const char *name;
+    BenchResult (*run)(const std::string &path);
+};
+
+typedef CorrelatingPredictor<5, 5> DefaultPredictor;
+typedef TournamentPredictor<8, CorrelatingPredictor<8, 8>,
+                            CorrelatingPredictor<0, 12>>
+    LargePredictor;
+// 默认配置打开全部指令融合和 16 条指令的循环缓冲
+typedef CPU<DefaultPredictor, CacheMemory<4, 4, 4, 0, 2>, 8, 8, 4, 4, 40, 4, 8,
+            2, MulDivUnit<3, true>, 1, MulDivUnit<32, false>, 1,
+            uniformALUs<4>(fullALU), FuseAll, 16>
+    FusedLoopCPU;
+
+const Config configs[] = {
+    {"small",
+     runWorkload<CPU<BinaryPredictor<4, WeaklyB>, Memory<2>, 4, 4, 2>>},
+    {"default",
+     runWorkload<CPU<DefaultPredictor, CacheMemory<4, 4, 4, 0, 2>, 8, 8, 4>>},
+    {"default_fused_loop", runWorkload<FusedLoopCPU>},
+    {"large",
+     runWorkload<CPU<LargePredictor, CacheMemory<6, 8, 5, 0, 4>, 32, 16, 8>>},
+    {"large_2port",
+     runWorkload<
+         CPU<LargePredictor, CacheMemory<6, 8, 5, 0, 4, 2, 4>, 32, 16, 8>>},
+};
+
+// 每次运行放在子进程中，使峰值内存互不影响
+bool runIsolated(const Config &config, const std::string &path,
+                 BenchResult &result) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        int status = 0;
+        try {
+            BenchResult child_result = config.run(path);
+            if (write(fds[1], &child_result, sizeof(child_result)) !=
+                sizeof(child_result)) {
+                status = 1;
+            }
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            status = 1;
+        }
+        _exit(status);
+    }
+
+    close(fds[1]);
+    bool ok = pid > 0 && read(fds[0], &result, sizeof(result)) ==
+                             static_cast<ssize_t>(sizeof(result));
+    close(fds[0]);
+    if (pid > 0) {
+        int status;
+        waitpid(pid, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    return ok;
+}
+
+const char *csv_header =
+    "workload,config,cycles,instructions,construct_seconds,run_seconds,"
+    "cycles_per_sec,instructions_per_sec,peak_rss_kb";
+
+struct BaselineEntry {
+    uint64_t cycles;
+    double instructions_per_sec;
+};
+
+std::map<std::string, BaselineEntry> readBaseline(const std::string &path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error(std::format("Cannot open {}!", path));
+    }
+
+    std::map<std::string, BaselineEntry> baseline;
+    std::string line;
+    std::getline(in, line);
+    if (line != csv_header) {
+        throw std::runtime_error(
+            std::format("{} is not a benchmark result file!", path));
+    }
+    while (std::getline(in, line)) {
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        std::string field;
+        while (std::getline(ss, field, ',')) fields.push_back(field);
+        if (fields.size() != 9) continue;
+        baseline[fields[0] + "," + fields[1]] =
+            BaselineEntry{std::stoull(fields[2]), std::stod(fields[7])};
+    }
+    return baseline;
+}
+
+int main(int argc, char *argv[]) {
+    std::string workload_dir = BENCH_WORKLOAD_DIR;
+    std::string baseline_path;
+    std::string only;
+    size_t repeat = 3;
+    double threshold = 0.05;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() { return arg.substr(arg.find('=') + 1); };
+        if (arg.starts_with("--workloads=")) {
+            workload_dir = value();
+        } else if (arg.starts_with("--baseline=")) {
+            baseline_path = value();
+        } else if (arg.starts_with("--repeat=")) {
+            repeat = std::max(1UL, std::stoul(value()));
+        } else if (arg.starts_with("--threshold=")) {
+            threshold = std::stod(value());
+        } else if (arg.starts_with("--only=")) {
+            only = value();
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--workloads=DIR] [--repeat=N] [--only=NAME]"
+                         " [--baseline=FILE] [--threshold=RATIO]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    std::map<std::string, BaselineEntry> baseline;
+    if (!baseline_path.empty()) {
+        baseline = readBaseline(baseline_path);
+    }
+
+    int exit_code = 0;
+    std::cout << csv_header << std::endl;
+    for (const auto &workload : workloads) {
+        if (!only.empty() && only != workload.name) continue;
+        std::string path =
+            std::format("{}/{}.data", workload_dir, workload.name);
+
+        for (const auto &config : configs) {
+            // 取多次运行中最快的一次，减小宿主机噪声
+            BenchResult best{};
+            for (size_t i = 0; i < repeat; i++) {
+                BenchResult result;
+                if (!runIsolated(config, path, result)) {
+                    std::cerr << std::format("{} on {}: run failed",
+                                             workload.name, config.name)
+                              << std::endl;
+                    return 1;
+                }
+                if (result.ret != workload.expected) {
+                    std::cerr << std::format(
+                                     "{} on {}: wrong result {} (expected "
+                                     "{})",
+                                     workload.name, config.name, +result.ret,
+                                     +workload.expected)
+                              << std::endl;
+                    exit_code = 1;
+                }
+                if (i == 0 || result.run_seconds < best.run_seconds) {
+                    best = result;
+                }
+            }
+
+            double ips = best.instructions / best.run_seconds;
+            std::cout << std::format(
+                             "{},{},{},{},{:.6f},{:.6f},{:.0f},{:.0f},{}",
+                             workload.name, config.name, best.cycles,
+                             best.instructions, best.construct_seconds,
+                             best.run_seconds, best.cycles / best.run_seconds,
+                             ips, best.peak_rss_kb)
+                      << std::endl;
+
+            auto found =
+                baseline.find(std::format("{},{}", workload.name, config.name));
+            if (found == baseline.end()) continue;
+            double baseline_ips = found->second.instructions_per_sec;
+            if (ips < baseline_ips * (1 - threshold)) {
+                std::cerr << std::format(
+                                 "REGRESSION {} on {}: {:.0f} inst/s vs "
+                                 "baseline {:.0f} ({:+.1f}%)",
+                                 workload.name, config.name, ips, baseline_ips,
+                                 100 * (ips / baseline_ips - 1))
+                          << std::endl;
+                exit_code = exit_code ? exit_code : 2;
+            }
+            if (best.cycles != found->second.cycles) {
+                std::cerr << std::format(
+                                 "NOTE {} on {}: simulated cycles changed "
+                                 "from {} to {}",
+                                 workload.name, config.name,
+                                 found->second.cycles, best.cycles)
+                          << std::endl;
+            }
+        }
+    }
+
+    return exit_code;
+}
@@ -0,0 +1,141 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bus.hpp"
+#include "tag_match.hpp"
+#include "utils.hpp"
+
+// Wire、Reg、BusSelect 与缓存标记匹配的孤立微基准，输出每次操作的平均耗时（纳秒）
+
+volatile uint64_t sink;
+
+template <typename F>
+void measure(const std::string &name, size_t iterations, F body) {
+    body(iterations / 100);  // 预热
+    auto start = std::chrono::steady_clock::now();
+    body(iterations);
+    auto finished = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(finished - start)
+                    .count() /
+                iterations;
+    std::cout << std::format("{:<36} {:>10.3f} ns/op", name, ns) << std::endl;
+}
+
+struct Source {
+    size_t reorder_index;
+    CommonDataBus out() const { return CommonDataBus{reorder_index, 1, 0}; }
+};
+
+int main(int argc, char *argv[]) {
+    size_t iterations = argc > 1 ? std::stoul(argv[1]) : 10000000;
+
+    Wire<uint32_t> constant;
+    constant = LAM(42U);
+    measure("Wire::value (cache hit)", iterations, [&](size_t n) {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; i++) sum += constant.value();
+        sink = sum;
+    });
+    measure("Wire::value (evaluated)", iterations, [&](size_t n) {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            wire_time++;
+            sum += constant.value();
+        }
+        sink = sum;
+    });
+
+    // 链式 Wire：每个周期沿 8 级依赖求值一次
+    Wire<uint32_t> chain[8];
+    chain[0] = LAM(uint32_t(wire_time));
+    for (size_t i = 1; i < 8; i++) {
+        chain[i] = [&, i]() { return chain[i - 1].value() + 1; };
+    }
+    measure("Wire chain of 8 (evaluated)", iterations / 8, [&](size_t n) {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            wire_time++;
+            sum += chain[7].value();
+        }
+        sink = sum;
+    });
+
+    Reg<uint32_t> counter;
+    counter <= [&]() -> uint32_t { return counter + 1; };
+    measure("Reg::pull + Reg::update", iterations, [&](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            counter.pull();
+            counter.update();
+        }
+        sink = counter;
+    });
+
+    std::vector<Updatable *> updatables;
+    Reg<uint32_t> regs[64];
+    for (auto &reg : regs) {
+        reg <= [&]() -> uint32_t { return reg + 1; };
+        updatables.push_back(&reg);
+    }
+    measure("64 Reg via Updatable* (per Reg)", iterations, [&](size_t n) {
+        for (size_t i = 0; i < n / 64; i++) {
+            for (auto x : updatables) x->pull();
+            for (auto x : updatables) x->update();
+        }
+        sink = regs[0];
+    });
+
+    for (size_t count : {4, 16}) {
+        std::vector<Source> sources(count);
+        for (size_t position : {size_t(0), count - 1, count}) {
+            for (auto &source : sources) source.reorder_index = 0;
+            if (position < count) sources[position].reorder_index = 1;
+
+            std::string name =
+                position == count
+                    ? std::format("BusSelect {} sources, none", count)
+                    : std::format("BusSelect {} sources, hit at {}", count,
+                                  position);
+            measure(name, iterations, [&](size_t n) {
+                uint64_t sum = 0;
+                for (size_t i = 0; i < n; i++) {
+                    sum += BusSelect<CommonDataBus>(
+                               sources,
+                               [](const Source &x) { return x.out(); })
+                               .reorder_index;
+                }
+                sink = sum;
+            });
+        }
+    }
+
+    // 全部有效、命中最后一路的最坏情况
+    for (size_t ways : {8, 64}) {
+        std::vector<uint32_t> tags(ways);
+        for (size_t i = 0; i < ways; i++) tags[i] = packTag(uint32_t(i));
+        uint32_t key = packTag(uint32_t(ways - 1));
+        measure(std::format("matchTags {} ways", ways), iterations,
+                [&](size_t n) {
+                    uint64_t sum = 0;
+                    for (size_t i = 0; i < n; i++) {
+                        sum += matchTags(tags.data(), ways, key).hit;
+                    }
+                    sink = sum;
+                });
+        measure(std::format("matchTagsScalar {} ways", ways), iterations,
+                [&](size_t n) {
+                    uint64_t sum = 0;
+                    for (size_t i = 0; i < n; i++) {
+                        sum += matchTagsScalar(tags.data(), ways, key).hit;
+                    }
+                    sink = sum;
+                });
+    }
+
+    return 0;
+}
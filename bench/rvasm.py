@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""Tiny RV32IM assembler emitting the simulator's @addr hex-byte format."""
+import re, sys
+
+REGS = {f"x{i}": i for i in range(32)}
+ABI = "zero ra sp gp tp t0 t1 t2 s0 s1 a0 a1 a2 a3 a4 a5 a6 a7 s2 s3 s4 s5 s6 s7 s8 s9 s10 s11 t3 t4 t5 t6".split()
+for i, n in enumerate(ABI): REGS[n] = i
+REGS["fp"] = 8
+
+def reg(s): return REGS[s.strip()]
+
+R = {"add":(0,0),"sub":(0,0x20),"sll":(1,0),"slt":(2,0),"sltu":(3,0),"xor":(4,0),"srl":(5,0),"sra":(5,0x20),"or":(6,0),"and":(7,0),
+     "mul":(0,1),"mulh":(1,1),"mulhsu":(2,1),"mulhu":(3,1),"div":(4,1),"divu":(5,1),"rem":(6,1),"remu":(7,1)}
+IA = {"addi":0,"slti":2,"sltiu":3,"xori":4,"ori":6,"andi":7}
+SH = {"slli":(1,0),"srli":(5,0),"srai":(5,0x20)}
+LD = {"lb":0,"lh":1,"lw":2,"lbu":4,"lhu":5}
+ST = {"sb":0,"sh":1,"sw":2}
+BR = {"beq":0,"bne":1,"blt":4,"bge":5,"bltu":6,"bgeu":7}
+
+def enc_r(f7,rs2,rs1,f3,rd,op): return (f7<<25)|(rs2<<20)|(rs1<<15)|(f3<<12)|(rd<<7)|op
+def enc_i(imm,rs1,f3,rd,op): return ((imm&0xfff)<<20)|(rs1<<15)|(f3<<12)|(rd<<7)|op
+def enc_s(imm,rs2,rs1,f3,op): return (((imm>>5)&0x7f)<<25)|(rs2<<20)|(rs1<<15)|(f3<<12)|((imm&0x1f)<<7)|op
+def enc_b(imm,rs2,rs1,f3):
+    return (((imm>>12)&1)<<31)|(((imm>>5)&0x3f)<<25)|(rs2<<20)|(rs1<<15)|(f3<<12)|(((imm>>1)&0xf)<<8)|(((imm>>11)&1)<<7)|0x63
+def enc_u(imm,rd,op): return (imm&0xfffff000)|(rd<<7)|op
+def enc_j(imm,rd):
+    return (((imm>>20)&1)<<31)|(((imm>>1)&0x3ff)<<21)|(((imm>>11)&1)<<20)|(((imm>>12)&0xff)<<12)|(rd<<7)|0x6f
+
+def split_li(v):
+    v &= 0xffffffff
+    lo = v & 0xfff
+    if lo >= 0x800: lo -= 0x1000
+    hi = (v - lo) & 0xffffffff
+    return hi, lo
+
+def expand(mn, ops):
+    """Expand pseudo-instructions into a list of (mn, ops)."""
+    if mn == "nop": return [("addi", ["x0","x0","0"])]
+    if mn == "mv": return [("addi", [ops[0], ops[1], "0"])]
+    if mn == "not": return [("xori", [ops[0], ops[1], "-1"])]
+    if mn == "neg": return [("sub", [ops[0], "x0", ops[1]])]
+    if mn == "j": return [("jal", ["x0", ops[0]])]
+    if mn == "jr": return [("jalr", ["x0", ops[0], "0"])]
+    if mn == "ret": return [("jalr", ["x0", "ra", "0"])]
+    if mn == "call": return [("jal", ["ra", ops[0]])]
+    if mn == "beqz": return [("beq", [ops[0], "x0", ops[1]])]
+    if mn == "bnez": return [("bne", [ops[0], "x0", ops[1]])]
+    if mn == "bgt": return [("blt", [ops[1], ops[0], ops[2]])]
+    if mn == "ble": return [("bge", [ops[1], ops[0], ops[2]])]
+    if mn == "bgtu": return [("bltu", [ops[1], ops[0], ops[2]])]
+    if mn == "bleu": return [("bgeu", [ops[1], ops[0], ops[2]])]
+    if mn == "li":
+        v = int(ops[1], 0)
+        if -2048 <= v < 2048: return [("addi", [ops[0], "x0", str(v)])]
+        hi, lo = split_li(v)
+        return [("lui", [ops[0], str(hi >> 12)]), ("addi", [ops[0], ops[0], str(lo)])]
+    if mn == "la":
+        return [("lui", [ops[0], "%hi(" + ops[1] + ")"]), ("addi", [ops[0], ops[0], "%lo(" + ops[1] + ")"])]
+    return [(mn, ops)]
+
+def assemble(src):
+    lines = []
+    for raw in src.splitlines():
+        line = raw.split("#")[0].strip()
+        while line:
+            m = re.match(r"^([A-Za-z_.][\w.]*):\s*(.*)$", line)
+            if m:
+                lines.append(("label", m.group(1))); line = m.group(2).strip(); continue
+            break
+        if not line: continue
+        parts = line.split(None, 1)
+        mn = parts[0].lower()
+        ops = [o.strip() for o in parts[1].split(",")] if len(parts) > 1 else []
+        lines.append(("ins", mn, ops))
+    # pass 1
+    labels, pc, items = {}, 0, []
+    for l in lines:
+        if l[0] == "label": labels[l[1]] = pc; continue
+        mn, ops = l[1], l[2]
+        if mn == ".org": pc = int(ops[0], 0); items.append(("org", pc)); continue
+        if mn == ".word":
+            for o in ops: items.append(("word", pc, o)); pc += 4
+            continue
+        if mn == ".space":
+            n = int(ops[0], 0); items.append(("space", pc, n)); pc += n; continue
+        if mn == ".align":
+            a = 1 << int(ops[0]); np = (pc + a - 1) & ~(a - 1); items.append(("space", pc, np - pc)); pc = np; continue
+        for e in expand(mn, ops):
+            items.append(("ins", pc, e[0], e[1])); pc += 4
+    def val(s, pc):
+        s = s.strip()
+        m = re.match(r"%hi\((.*)\)", s)
+        if m: return split_li(val(m.group(1), pc))[0] >> 12
+        m = re.match(r"%lo\((.*)\)", s)
+        if m: return split_li(val(m.group(1), pc))[1]
+        if s in labels: return labels[s]
+        m = re.match(r"^([\w.]+)([+-]\d+)$", s)
+        if m and m.group(1) in labels: return labels[m.group(1)] + int(m.group(2))
+        return int(s, 0)
+    def mem(s):
+        m = re.match(r"^(.*)\((\w+)\)$", s.strip())
+        off = m.group(1).strip() or "0"
+        return off, reg(m.group(2))
+    out = {}
+    for it in items:
+        if it[0] == "org": continue
+        if it[0] == "word":
+            w = val(it[2], it[1]) & 0xffffffff
+        elif it[0] == "space":
+            for i in range(it[2]): out[it[1] + i] = 0
+            continue
+        else:
+            _, pc, mn, ops = it
+            if mn in R: f3, f7 = R[mn]; w = enc_r(f7, reg(ops[2]), reg(ops[1]), f3, reg(ops[0]), 0x33)
+            elif mn in IA: w = enc_i(val(ops[2], pc), reg(ops[1]), IA[mn], reg(ops[0]), 0x13)
+            elif mn in SH: f3, f7 = SH[mn]; w = enc_r(f7, val(ops[2], pc) & 31, reg(ops[1]), f3, reg(ops[0]), 0x13)
+            elif mn in LD: off, rs1 = mem(ops[1]); w = enc_i(val(off, pc), rs1, LD[mn], reg(ops[0]), 0x03)
+            elif mn in ST: off, rs1 = mem(ops[1]); w = enc_s(val(off, pc), reg(ops[0]), rs1, ST[mn], 0x23)
+            elif mn in BR: w = enc_b(val(ops[2], pc) - pc, reg(ops[1]), reg(ops[0]), BR[mn])
+            elif mn == "lui": w = enc_u(val(ops[1], pc) << 12, reg(ops[0]), 0x37)
+            elif mn == "auipc": w = enc_u(val(ops[1], pc) << 12, reg(ops[0]), 0x17)
+            elif mn == "jal":
+                if len(ops) == 1: ops = ["ra"] + ops
+                w = enc_j(val(ops[1], pc) - pc, reg(ops[0]))
+            elif mn == "jalr":
+                if len(ops) == 2 and "(" in ops[1]:
+                    off, rs1 = mem(ops[1]); ops = [ops[0], ABI[rs1], off]
+                w = enc_i(val(ops[2], pc), reg(ops[1]), 0, reg(ops[0]), 0x67)
+            else: raise SystemExit(f"unknown mnemonic {mn}")
+            pc = it[1]
+        for i in range(4): out[it[1] + i] = (w >> (8 * i)) & 0xff
+    return out
+
+def emit(out):
+    res, prev = [], None
+    line = []
+    for a in sorted(out):
+        if prev is None or a != prev + 1:
+            if line: res.append(" ".join(line)); line = []
+            res.append(f"@{a:08X}")
+        line.append(f"{out[a]:02X}")
+        if len(line) == 16: res.append(" ".join(line)); line = []
+        prev = a
+    if line: res.append(" ".join(line))
+    return "\n".join(res) + "\n"
+
+if __name__ == "__main__":
+    print(emit(assemble(open(sys.argv[1]).read())), end="")
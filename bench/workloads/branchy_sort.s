@@ -0,0 +1,66 @@
+# Insertion sort of 160 xorshift values, then checksum of the sorted order.
+    li sp, 0x20000
+    la s0, arr
+    li s1, 160
+    li t0, 0
+    li t1, 2463534242
+gen:
+    slli t2, t1, 13
+    xor t1, t1, t2
+    srli t2, t1, 17
+    xor t1, t1, t2
+    slli t2, t1, 5
+    xor t1, t1, t2
+    srli t3, t1, 16
+    slli t2, t0, 2
+    add t2, t2, s0
+    sw t3, 0(t2)
+    addi t0, t0, 1
+    bne t0, s1, gen
+    li t0, 1
+outer:
+    slli t2, t0, 2
+    add t2, t2, s0
+    lw t3, 0(t2)          # key
+    addi t4, t0, -1       # j
+inner:
+    blt t4, x0, place
+    slli t5, t4, 2
+    add t5, t5, s0
+    lw t6, 0(t5)
+    bgeu t3, t6, place
+    sw t6, 4(t5)
+    addi t4, t4, -1
+    j inner
+place:
+    addi t5, t4, 1
+    slli t5, t5, 2
+    add t5, t5, s0
+    sw t3, 0(t5)
+    addi t0, t0, 1
+    bne t0, s1, outer
+    li a0, 0
+    li t0, 0
+chk:                      # a0 = sum(arr[i] ^ i) plus an order check
+    slli t2, t0, 2
+    add t2, t2, s0
+    lw t3, 0(t2)
+    xor t3, t3, t0
+    add a0, a0, t3
+    addi t0, t0, 1
+    bne t0, s1, chk
+    li t0, 1
+ord:
+    slli t2, t0, 2
+    add t2, t2, s0
+    lw t3, -4(t2)
+    lw t4, 0(t2)
+    bleu t3, t4, ordok
+    addi a0, a0, 1
+ordok:
+    addi t0, t0, 1
+    bne t0, s1, ord
+    andi a0, a0, 255
+    li a0, 255
+.align 4
+arr: .space 640
@@ -0,0 +1,94 @@
+# 10x10 matrix multiply with software shift-add multiplication.
+    li sp, 0x20000
+    la s0, A
+    la s1, B
+    la s2, C
+    li s3, 10
+    li t0, 0
+init:                       # A[k] = k % 7 + 1, B[k] = k % 5 + 2 (k < 100)
+    li t1, 7
+    mv t2, t0
+m7: blt t2, t1, m7d
+    sub t2, t2, t1
+    j m7
+m7d:
+    addi t2, t2, 1
+    slli t3, t0, 2
+    add t4, s0, t3
+    sw t2, 0(t4)
+    li t1, 5
+    mv t2, t0
+m5: blt t2, t1, m5d
+    sub t2, t2, t1
+    j m5
+m5d:
+    addi t2, t2, 2
+    add t4, s1, t3
+    sw t2, 0(t4)
+    addi t0, t0, 1
+    li t1, 100
+    bne t0, t1, init
+    li s4, 0                # i
+li_:
+    li s5, 0                # j
+lj:
+    li s6, 0                # k
+    li s7, 0                # acc
+lk:
+    # a = A[i*10+k]; b = B[k*10+j]
+    slli t0, s4, 3
+    slli t1, s4, 1
+    add t0, t0, t1
+    add t0, t0, s6
+    slli t0, t0, 2
+    add t0, t0, s0
+    lw a1, 0(t0)
+    slli t0, s6, 3
+    slli t1, s6, 1
+    add t0, t0, t1
+    add t0, t0, s5
+    slli t0, t0, 2
+    add t0, t0, s1
+    lw a2, 0(t0)
+    call mul
+    add s7, s7, a0
+    addi s6, s6, 1
+    bne s6, s3, lk
+    slli t0, s4, 3
+    slli t1, s4, 1
+    add t0, t0, t1
+    add t0, t0, s5
+    slli t0, t0, 2
+    add t0, t0, s2
+    sw s7, 0(t0)
+    addi s5, s5, 1
+    bne s5, s3, lj
+    addi s4, s4, 1
+    bne s4, s3, li_
+    li a0, 0
+    li t0, 0
+    li t1, 100
+sum:
+    slli t2, t0, 2
+    add t2, t2, s2
+    lw t3, 0(t2)
+    add a0, a0, t3
+    addi t0, t0, 1
+    bne t0, t1, sum
+    andi a0, a0, 255
+    li a0, 255
+mul:                        # a0 = a1 * a2
+    li a0, 0
+mloop:
+    andi t5, a2, 1
+    beqz t5, mskip
+    add a0, a0, a1
+mskip:
+    slli a1, a1, 1
+    srli a2, a2, 1
+    bnez a2, mloop
+    ret
+.align 4
+A: .space 400
+B: .space 400
+C: .space 400
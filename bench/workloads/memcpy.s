@@ -0,0 +1,61 @@
+# Word/byte memcpy: copy 1 KiB back and forth 4 times, then checksum.
+    li sp, 0x20000
+    la s0, src
+    la s1, dst
+    li t0, 0
+    li t1, 256
+fill:
+    slli t2, t0, 2
+    add t2, t2, s0
+    slli t3, t0, 5
+    addi t3, t3, 7
+    xor t3, t3, t0
+    sw t3, 0(t2)
+    addi t0, t0, 1
+    bne t0, t1, fill
+    li s2, 4
+rep:
+    mv a0, s1
+    mv a1, s0
+    li a2, 1024
+    call copy
+    mv a0, s0
+    mv a1, s1
+    li a2, 1024
+    call copyb
+    addi s2, s2, -1
+    bnez s2, rep
+    li a0, 0
+    li t0, 0
+    li t1, 1024
+sum:
+    add t2, t0, s1
+    lbu t3, 0(t2)
+    add a0, a0, t3
+    add t2, t0, s0
+    lb t3, 0(t2)
+    add a0, a0, t3
+    addi t0, t0, 4
+    bne t0, t1, sum
+    srli a0, a0, 3
+    andi a0, a0, 255
+    li a0, 255
+copy:                     # word copy, a2 bytes
+    add a3, a1, a2
+cw: lw t3, 0(a1)
+    sw t3, 0(a0)
+    addi a1, a1, 4
+    addi a0, a0, 4
+    bne a1, a3, cw
+    ret
+copyb:                    # halfword copy
+    add a3, a1, a2
+ch: lhu t3, 0(a1)
+    sh t3, 0(a0)
+    addi a1, a1, 2
+    addi a0, a0, 2
+    bne a1, a3, ch
+    ret
+.align 4
+src: .space 1024
+dst: .space 1024
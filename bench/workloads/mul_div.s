@@ -0,0 +1,90 @@
+# RV32IM kernel: 10x10 matrix multiply with mul, then gcd and decimal digit
+# sums of the products with rem/divu/remu.
+    li sp, 0x20000
+    la s0, A
+    la s1, B
+    la s2, C
+    li s3, 10
+    li t0, 0
+    li t1, 100
+init:                       # A[k] = k * 37 % 101 + 1, B[k] = k * 13 % 29 - 7
+    li t2, 37
+    mul t3, t0, t2
+    li t2, 101
+    rem t3, t3, t2
+    addi t3, t3, 1
+    slli t4, t0, 2
+    add t5, s0, t4
+    sw t3, 0(t5)
+    li t2, 13
+    mul t3, t0, t2
+    li t2, 29
+    rem t3, t3, t2
+    addi t3, t3, -7
+    add t5, s1, t4
+    sw t3, 0(t5)
+    addi t0, t0, 1
+    bne t0, t1, init
+    li s4, 0                # i
+li_:
+    li s5, 0                # j
+lj:
+    li s6, 0                # k
+    li s7, 0                # acc
+    mul t0, s4, s3          # &A[i][0]
+    slli t0, t0, 2
+    add a3, s0, t0
+    slli t0, s5, 2          # &B[0][j]
+    add a4, s1, t0
+lk:
+    lw a1, 0(a3)
+    lw a2, 0(a4)
+    mul t1, a1, a2
+    add s7, s7, t1
+    addi a3, a3, 4
+    addi a4, a4, 40
+    addi s6, s6, 1
+    bne s6, s3, lk
+    mul t0, s4, s3          # C[i][j]
+    add t0, t0, s5
+    slli t0, t0, 2
+    add t0, t0, s2
+    sw s7, 0(t0)
+    addi s5, s5, 1
+    bne s5, s3, lj
+    addi s4, s4, 1
+    bne s4, s3, li_
+    li a0, 0
+    li s4, 0
+    li s5, 100
+    li s6, 10
+sum:                        # a0 += gcd(|C[k]|, k + 1) + digitsum(|C[k]|)
+    slli t0, s4, 2
+    add t0, t0, s2
+    lw t1, 0(t0)
+    bge t1, zero, pos
+    neg t1, t1
+pos:
+    mv t2, t1
+    addi t3, s4, 1
+gcd:
+    beqz t3, gcd_done
+    rem t4, t2, t3
+    mv t2, t3
+    mv t3, t4
+    j gcd
+gcd_done:
+    add a0, a0, t2
+digits:
+    remu t4, t1, s6
+    add a0, a0, t4
+    divu t1, t1, s6
+    bnez t1, digits
+    addi s4, s4, 1
+    bne s4, s5, sum
+    andi a0, a0, 255
+    li a0, 255
+.align 4
+A: .space 400
+B: .space 400
+C: .space 400
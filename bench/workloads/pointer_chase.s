@@ -0,0 +1,35 @@
+# Pointer chase: build a 256-node ring with a scattered stride, walk it 8 times.
+    li sp, 0x20000
+    la s0, nodes          # base
+    li s1, 256            # node count
+    li t0, 0              # i
+build:
+    # next = (i * 97 + 1) & 255, node size 16 bytes
+    slli t1, t0, 5
+    add t2, t1, t0        # i*33
+    slli t1, t0, 6
+    add t2, t2, t1        # i*97
+    addi t2, t2, 1
+    andi t2, t2, 255
+    slli t3, t0, 4
+    add t3, t3, s0        # &node[i]
+    slli t4, t2, 4
+    add t4, t4, s0        # &node[next]
+    sw t4, 0(t3)
+    sw t0, 4(t3)
+    addi t0, t0, 1
+    bne t0, s1, build
+    li a0, 0
+    li s2, 2001           # steps
+    mv t0, s0
+walk:
+    lw t1, 4(t0)
+    add a0, a0, t1
+    lw t0, 0(t0)
+    addi s2, s2, -1
+    bnez s2, walk
+    andi a0, a0, 255
+    li a0, 255
+.align 4
+nodes:
+.space 4096
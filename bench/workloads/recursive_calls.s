@@ -0,0 +1,26 @@
+# Recursive fibonacci(16) using the stack.
+    li sp, 0x20000
+    li a0, 16
+    call fib
+    andi a0, a0, 255
+    li a0, 255
+fib:
+    li t0, 2
+    blt a0, t0, fibret
+    addi sp, sp, -12
+    sw ra, 8(sp)
+    sw s0, 4(sp)
+    sw s1, 0(sp)
+    mv s0, a0
+    addi a0, a0, -1
+    call fib
+    mv s1, a0
+    addi a0, s0, -2
+    call fib
+    add a0, a0, s1
+    lw s1, 0(sp)
+    lw s0, 4(sp)
+    lw ra, 8(sp)
+    addi sp, sp, 12
+fibret:
+    ret
@@ -0,0 +1,208 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <exception>
+#include <format>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "predictor.hpp"
+#include "trace.hpp"
+#include "utils.hpp"
+
+// 用分支轨迹离线比较各种分支预测器：按提交顺序把每条条件分支交给预测器预测，
+// 随即反馈实际方向，相当于预测器在分支提交前没有别的分支在途。
+// jalr 的目标由发射时的寄存器值算出，不经过预测器，只作为反馈传入
+
+struct EvalResult {
+    uint64_t branches;
+    uint64_t correct;
+};
+
+template <typename PredictorType>
+EvalResult evaluate(const std::vector<BranchRecord> &records) {
+    PredictorType predictor;
+    uint32_t PC = 0;
+    PredictFeedbackBus feedback{PredictFeedbackBus::Invalid, 0, 0, 0};
+    predictor.PC = LAM(PC);
+    predictor.feedback = LAM(feedback);
+    // 没有在途的分支：推测的历史每个周期都恢复为已提交的历史
+    predictor.clear = []() { return true; };
+
+    // 每个记录一个周期：先用旧状态预测，再按反馈训练
+    EvalResult result{};
+    for (const BranchRecord &record : records) {
+        wire_time++;
+        PC = record.PC;
+        if (record.kind == BranchRecord::Branch) {
+            bool predicted = predictor.branch();
+            feedback = PredictFeedbackBus{PredictFeedbackBus::Branch,
+                                          predicted, predicted != record.taken,
+                                          record.PC};
+            result.branches++;
+            result.correct += predicted == record.taken;
+        } else {
+            feedback = PredictFeedbackBus{PredictFeedbackBus::Jalr, 0, 0,
+                                          record.PC};
+        }
+        predictor.pull();
+        predictor.update();
+    }
+    return result;
+}
+
+struct Candidate {
+    const char *name;
+    EvalResult (*run)(const std::vector<BranchRecord> &records);
+};
+
+const Candidate candidates[] = {
+    {"always", evaluate<AlwaysBranchPredictor>},
+    {"never", evaluate<NeverBranchPredictor>},
+    {"bimodal_4", evaluate<BinaryPredictor<4, WeaklyB>>},
+    {"bimodal_10", evaluate<BinaryPredictor<10, WeaklyB>>},
+    {"correlating_5_5", evaluate<CorrelatingPredictor<5, 5>>},
+    {"correlating_8_8", evaluate<CorrelatingPredictor<8, 8>>},
+    {"global_10", evaluate<CorrelatingPredictor<0, 10>>},
+    {"global_12", evaluate<CorrelatingPredictor<0, 12>>},
+    {"tournament_5",
+     evaluate<TournamentPredictor<5, CorrelatingPredictor<5, 5>,
+                                  CorrelatingPredictor<0, 10>>>},
+    {"tournament_8",
+     evaluate<TournamentPredictor<8, CorrelatingPredictor<8, 8>,
+                                  CorrelatingPredictor<0, 12>>>},
+};
+
+// 各预测器在自己的子进程中运行：Wire 的缓存按全局的 wire_time 判断，
+// 不能在一个进程里多线程推进
+struct Job {
+    const Candidate *candidate;
+    pid_t pid;
+    int fd;
+};
+
+Job startJob(const Candidate &candidate,
+             const std::vector<BranchRecord> &records) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        throw std::runtime_error("Cannot create a pipe!");
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        EvalResult result = candidate.run(records);
+        bool ok = write(fds[1], &result, sizeof(result)) == sizeof(result);
+        _exit(ok ? 0 : 1);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        throw std::runtime_error("Cannot fork!");
+    }
+    return Job{&candidate, pid, fds[0]};
+}
+
+bool finishJob(const Job &job, EvalResult &result) {
+    bool ok = read(job.fd, &result, sizeof(result)) ==
+              static_cast<ssize_t>(sizeof(result));
+    close(job.fd);
+    int status;
+    waitpid(job.pid, &status, 0);
+    return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<std::string> selected;
+    std::string path;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.starts_with("--predictors=")) {
+            std::stringstream ss(arg.substr(13));
+            std::string item;
+            while (std::getline(ss, item, ',')) {
+                if (!item.empty()) selected.push_back(item);
+            }
+        } else if (path.empty() && !arg.starts_with("--")) {
+            path = arg;
+        } else {
+            path.clear();
+            break;
+        }
+    }
+    if (path.empty()) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--predictors=NAME,...] BRANCH_TRACE\nPredictors:";
+        for (const Candidate &candidate : candidates) {
+            std::cerr << ' ' << candidate.name;
+        }
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    try {
+        std::vector<const Candidate *> chosen;
+        for (const Candidate &candidate : candidates) {
+            if (selected.empty()) chosen.push_back(&candidate);
+        }
+        for (const std::string &name : selected) {
+            const Candidate *found = nullptr;
+            for (const Candidate &candidate : candidates) {
+                if (name == candidate.name) found = &candidate;
+            }
+            if (!found) {
+                throw std::runtime_error(
+                    std::format("Unknown predictor {}!", name));
+            }
+            chosen.push_back(found);
+        }
+
+        BranchTraceReader reader(path);
+        std::vector<BranchRecord> records;
+        BranchRecord record;
+        uint64_t taken = 0;
+        uint64_t jalrs = 0;
+        while (reader.next(record)) {
+            records.push_back(record);
+            taken += record.kind == BranchRecord::Branch && record.taken;
+            jalrs += record.kind == BranchRecord::Jalr;
+        }
+        uint64_t instructions = reader.instructionCount();
+
+        // 先全部启动再依次收集结果
+        std::vector<Job> jobs;
+        for (const Candidate *candidate : chosen) {
+            jobs.push_back(startJob(*candidate, records));
+        }
+
+        std::cout << std::format(
+            "# {}: {} instructions, {} branches ({} taken), {} jalr\n"
+            "{:<16} {:>10} {:>10} {:>9} {:>8}\n",
+            path, instructions, records.size() - jalrs, taken, jalrs,
+            "predictor", "branches", "mispredict", "accuracy", "MPKI");
+        int exit_code = 0;
+        for (const Job &job : jobs) {
+            EvalResult result;
+            if (!finishJob(job, result)) {
+                std::cerr << std::format("{} failed!", job.candidate->name)
+                          << std::endl;
+                exit_code = 1;
+                continue;
+            }
+            uint64_t mispredicts = result.branches - result.correct;
+            std::cout << std::format(
+                "{:<16} {:>10} {:>10} {:>9.4f} {:>8.3f}\n",
+                job.candidate->name, result.branches, mispredicts,
+                result.branches ? 1.0 * result.correct / result.branches : 0.0,
+                instructions ? 1000.0 * mispredicts / instructions : 0.0);
+        }
+        return exit_code;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -3,8 +3,16 @@
 #include <cstddef>
 #include <cstdint>
 
+// ALU_T 为加减、比较与逻辑运算，Shift_T 为移位，Branch_T 为条件分支的比较与
+// jal/jalr 的返回地址
+enum ExecuteType { None_T, ALU_T, Mem_T, Mul_T, Div_T, Shift_T, Branch_T };
+
+// 功能单元接受的指令类别按位组合
+constexpr unsigned typeBit(ExecuteType type) { return 1U << type; }
+
 struct RSBus {
     size_t reorder_index;
+    ExecuteType type;
     size_t qj;
     size_t qk;
 
@@ -30,6 +38,8 @@ struct MemBus {
     uint8_t mode;
     uint32_t address;
     uint32_t input;
+    bool forwarded;  // 读请求的数据已由 store buffer 给出，放在 input 中
+    uint32_t PC;     // 发出读请求的 load 的地址，只用于统计
 };
 
 struct PCBus {
@@ -38,24 +48,53 @@ struct PCBus {
     uint32_t offset;
 };
 
+// 分支在执行时发现预测失败，ROB 中比 branch 新的指令全部作废
+struct SquashBus {
+    bool flag;
+    size_t head;    // 当前的 ROB 队头
+    // 保留的最新表项：预测失败的分支，或要重新执行的 load 的前一项
+    size_t branch;
+    size_t length;  // ROB 长度
+    bool replay;    // 因访存违例从 branch 的下一项重新执行
+
+    bool younger(size_t reorder_index) const {
+        if (!flag || reorder_index == 0) {
+            return false;
+        }
+        auto age = [&](size_t index) {
+            return index >= head ? index - head : index + length - head;
+        };
+        return age(reorder_index) > age(branch);
+    }
+};
+
 struct CommonDataBus {
     size_t reorder_index;
     uint32_t data;
+    // 结果写入的物理寄存器，0 表示不写寄存器。执行单元一律给出 0，
+    // 由 CDBSelect 按 ROB 表项填入
+    size_t preg;
 };
 
 struct RegIssueBus {
     uint8_t rd;
     size_t reorder_index;
+    size_t preg;  // 为 rd 新分配的物理寄存器
+    size_t prev;  // rd 原先映射的物理寄存器，提交时释放
+    bool ready;   // lui 在发射时即得到结果
+    uint32_t value;
 };
 
 struct RegCommitBus {
     size_t reorder_index;
     uint8_t rd;
     uint32_t data;
+    size_t preg;
+    size_t prev;
 };
 
 struct RegValueBus {
-    size_t q;
+    size_t q;  // 等待的物理寄存器，0 表示 v 已就绪
     uint32_t v;
 };
 
@@ -79,4 +118,12 @@ struct PredictFeedbackBus {
     bool predict_branch;
     bool is_mispredicted;
     uint32_t PC;
+};
+
+// 推测地更新预测器历史的条件分支：取指用掉了预测，或发射进了 ROB
+struct BranchHistoryBus {
+    bool flag;
+    uint32_t PC;
+    bool branched;         // 取指时预测的方向
+    size_t reorder_index;  // 发射时分到的 ROB 下标，取指时为 0
 };
\ No newline at end of file
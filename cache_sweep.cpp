@@ -0,0 +1,195 @@
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <format>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stack_distance.hpp"
+#include "trace.hpp"
+
+// 从访存地址轨迹离线评估一组缓存配置（LRU 替换，每次访问都分配缓存行）。
+// 每种行大小在一个线程中扫描一遍轨迹：按组数各求一遍组内栈距离得到所有相联度，
+// 再求一遍全相联栈距离得到所有容量
+struct SweepResult {
+    size_t line_size;
+    // by_sets[k][d]：2^k 组时组内栈距离为 d 的访问数
+    std::vector<std::vector<size_t>> by_sets;
+    // full[d]：全相联栈距离为 d 的访问数，更远的不计
+    std::vector<size_t> full;
+};
+
+SweepResult sweep(const std::vector<uint32_t> &addresses, size_t line_size,
+                  size_t max_sets, size_t max_ways) {
+    SweepResult result{line_size, {}, std::vector<size_t>(max_sets * max_ways)};
+    std::vector<SetStackDistance> set_stacks;
+    for (size_t sets = 1; sets <= max_sets; sets *= 2) {
+        set_stacks.emplace_back(sets, max_ways);
+        result.by_sets.emplace_back(max_ways);
+    }
+    StackDistance full_stack;
+
+    for (uint32_t address : addresses) {
+        uint64_t line = address / line_size;
+        for (size_t k = 0; k < set_stacks.size(); k++) {
+            size_t distance = set_stacks[k].access(line);
+            if (distance != infiniteDistance) {
+                result.by_sets[k][distance]++;
+            }
+        }
+        size_t distance = full_stack.access(line);
+        if (distance < result.full.size()) {
+            result.full[distance]++;
+        }
+    }
+    return result;
+}
+
+size_t parsePowerOfTwo(const std::string &text, const std::string &what) {
+    size_t value = std::stoull(text);
+    if (value == 0 || (value & (value - 1)) != 0) {
+        throw std::runtime_error(
+            std::format("{} must be a power of two, got {}!", what, text));
+    }
+    return value;
+}
+
+std::vector<std::string> splitList(const std::string &text) {
+    std::vector<std::string> items;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+// 每种行大小一张表：行为容量，列为相联度，最后一列为全相联
+void printResult(const SweepResult &result, size_t total, size_t max_sets,
+                 size_t max_ways) {
+    std::cout << std::format("# line {} B\n{:>12}", result.line_size,
+                             "capacity");
+    for (size_t ways = 1; ways <= max_ways; ways *= 2) {
+        std::cout << std::format(" {:>8}", std::format("{}-way", ways));
+    }
+    std::cout << std::format(" {:>8}\n", "full");
+
+    auto rate = [&](size_t hits) {
+        return std::format(" {:>8.4f}", total ? 1.0 * hits / total : 0.0);
+    };
+
+    for (size_t lines = 1; lines <= max_sets * max_ways; lines *= 2) {
+        std::cout << std::format("{:>10} B", lines * result.line_size);
+        for (size_t ways = 1; ways <= max_ways; ways *= 2) {
+            size_t sets = lines / ways;
+            if (sets == 0 || sets > max_sets) {
+                std::cout << std::format(" {:>8}", "-");
+                continue;
+            }
+            size_t k = std::countr_zero(sets);
+            size_t hits = 0;
+            for (size_t d = 0; d < ways; d++) hits += result.by_sets[k][d];
+            std::cout << rate(hits);
+        }
+        size_t hits = 0;
+        for (size_t d = 0; d < lines; d++) hits += result.full[d];
+        std::cout << rate(hits) << '\n';
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<size_t> line_sizes{16, 32, 64};
+    size_t max_sets = 1024;
+    size_t max_ways = 16;
+    bool kinds[3] = {false, true, true};  // 按 AddressRecord::Kind
+    std::string path;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg.starts_with("--lines=")) {
+                line_sizes.clear();
+                for (const auto &item : splitList(arg.substr(8))) {
+                    line_sizes.push_back(parsePowerOfTwo(item, "Line size"));
+                }
+            } else if (arg.starts_with("--max-sets=")) {
+                max_sets = parsePowerOfTwo(arg.substr(11), "Set count");
+            } else if (arg.starts_with("--max-ways=")) {
+                max_ways = parsePowerOfTwo(arg.substr(11), "Associativity");
+            } else if (arg.starts_with("--kinds=")) {
+                kinds[0] = kinds[1] = kinds[2] = false;
+                for (const auto &item : splitList(arg.substr(8))) {
+                    if (item == "fetch") {
+                        kinds[AddressRecord::Fetch] = true;
+                    } else if (item == "load") {
+                        kinds[AddressRecord::Load] = true;
+                    } else if (item == "store") {
+                        kinds[AddressRecord::Store] = true;
+                    } else {
+                        throw std::runtime_error(
+                            std::format("Unknown access kind {}!", item));
+                    }
+                }
+            } else if (path.empty() && !arg.starts_with("--")) {
+                path = arg;
+            } else {
+                path.clear();
+                break;
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (path.empty() || line_sizes.empty()) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--lines=16,32,64] [--max-sets=1024] [--max-ways=16]"
+                     " [--kinds=fetch,load,store] ADDRESS_TRACE"
+                  << std::endl;
+        return 1;
+    }
+
+    try {
+        AddressTraceReader reader(path);
+        if (kinds[AddressRecord::Fetch] && !reader.hasFetches()) {
+            throw std::runtime_error(std::format(
+                "{} has no fetch addresses, rerun with --trace-fetches!",
+                path));
+        }
+
+        std::vector<uint32_t> addresses;
+        AddressRecord record;
+        while (reader.next(record)) {
+            if (kinds[record.kind]) addresses.push_back(record.address);
+        }
+
+        // 各行大小互不相关，每种一个线程
+        std::vector<SweepResult> results(line_sizes.size());
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < line_sizes.size(); i++) {
+            workers.emplace_back([&, i]() {
+                results[i] =
+                    sweep(addresses, line_sizes[i], max_sets, max_ways);
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+
+        std::cout << std::format("# {}: {} accesses, LRU hit rates\n", path,
+                                 addresses.size());
+        for (const auto &result : results) {
+            printResult(result, addresses.size(), max_sets, max_ways);
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
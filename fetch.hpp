@@ -0,0 +1,417 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "bus.hpp"
+#include "memory.hpp"
+#include "stats.hpp"
+#include "utils.hpp"
+
+// 取指单元：每周期从 fetch_PC 起顺序取至多 Width 条指令放进容量为 QueueSize
+// 的指令队列，发射阶段从队头取指令。取指块在第一条条件分支或 jal 处结束，条件
+// 分支的方向由分支预测器给出；jalr 的目标要等它发射时由寄存器值算出，在此之前
+// 停止取指。后端阻塞时取指继续向前，直到队列填满。
+// 取指可以领先提交 QueueSize + ROB 长度条指令，用掉的预测由 predicted() 交给
+// 预测器推测地更新历史，否则预测读到的是很久以前提交时的历史。
+// LoopSize 不为 0 时带一个循环缓冲：以向后跳转的条件分支结尾、不超过 LoopSize
+// 条的直线循环体被完整取到一遍后锁定，之后从缓冲中重放，不再读指令存储器，
+// 直到取指离开循环体或后端让取指转向。循环体中的条件分支仍照常查分支预测器：
+// 认为结尾的分支总是跳转能再省下预测器的查询，但每次退出循环都要预测失败
+template <size_t Width, size_t QueueSize, size_t LoopSize = 0>
+    requires(Width > 0 && QueueSize > 0)
+class FetchUnit : public Updatable {
+   public:
+    struct Entry {
+        uint32_t PC;
+        uint32_t instruction;
+        bool branched;  // 预测跳转
+    };
+
+   private:
+    struct Block {
+        bool valid;  // 本周期是否从某个地址取指（队列满时可以一条也没取到）
+        size_t length;
+        Entry entries[Width];
+        uint32_t next_PC;
+        bool wait;  // 取到了 jalr 或无法识别的指令，之后停止取指
+        bool from_loop;  // 从循环缓冲中重放
+        bool predicted;  // 结尾的条件分支查了分支预测器
+    };
+
+    enum LoopState { LoopIdle, LoopCapture, LoopStream };
+
+    // 循环体为 [start, end]，end 处是向后跳转的分支；
+    // 记录时 captured 是已按顺序取到的条数
+    struct LoopTracker {
+        LoopState state;
+        uint32_t start;
+        uint32_t end;
+        size_t captured;
+
+        size_t length() const { return (end - start) / 4 + 1; }
+    };
+
+    Reg<uint32_t> fetch_PC;
+    Reg<bool> waiting;
+    Reg<size_t> head;
+    Reg<size_t> count;
+
+    // 按字段分开存放的环形队列，只在 update 时写入新取到的表项
+    uint32_t PC_of[QueueSize];
+    uint32_t instruction_of[QueueSize];
+    bool branched_of[QueueSize];
+
+    Reg<LoopTracker> loop;
+    uint32_t loop_instruction_of[LoopSize > 0 ? LoopSize : 1];
+
+    const BaseMemory &mem;
+
+    Wire<Block> block;
+    Block latched_block;
+    bool latched_flush;
+    LoopTracker latched_loop;
+
+    StatHistogram occupancy;
+    StatCounter fetched_count;
+    StatCounter queue_full_count;
+    StatCounter jalr_wait_count;
+    StatCounter redirect_count;
+    StatCounter mem_read_count;
+    StatCounter lookup_count;
+    StatCounter loop_hit_count;
+    StatCounter loop_lock_count;
+    StatCounter loop_exit_count;
+
+    static uint32_t target(const PCBus &bus) {
+        return (bus.address + bus.offset) & 0xFFFFFFFEU;
+    }
+
+    // 本周期取指的起始地址，返回 false 表示在等待 jalr
+    bool start(uint32_t &address) {
+        PCBus relocate = redirect;
+        if (relocate.flag) {
+            address = target(relocate);
+            return true;
+        }
+        if (waiting) {
+            PCBus jalr = resume;
+            address = target(jalr);
+            return jalr.flag;
+        }
+        address = fetch_PC;
+        return true;
+    }
+
+    bool streaming(uint32_t address) const {
+        const LoopTracker &l = loop;
+        return LoopSize > 0 && l.state == LoopStream && address >= l.start &&
+               address <= l.end;
+    }
+
+    // address 处的指令，锁定的循环体从循环缓冲中读
+    uint32_t instructionAt(uint32_t address, bool from_loop) const {
+        if (from_loop) {
+            const LoopTracker &l = loop;
+            return loop_instruction_of[(address - l.start) / 4];
+        }
+        return mem.get_instruction(address);
+    }
+
+    // 本周期队列中可以放新指令的位置数
+    size_t room() {
+        size_t free =
+            redirect.value().flag ? QueueSize : QueueSize - count + issued;
+        return free < Width ? free : Width;
+    }
+
+    Block fetch() {
+        Block result{};
+        uint32_t address;
+        if (!start(address)) {
+            return result;
+        }
+
+        result.valid = true;
+        result.next_PC = address;
+        // 锁定的循环体中没有 jal、jalr，取指块至多到结尾的分支为止
+        result.from_loop = streaming(address);
+        size_t limit = room();
+        while (result.length < limit) {
+            uint32_t instruction = instructionAt(address, result.from_loop);
+            uint8_t op = get_op(instruction);
+            Entry &entry = result.entries[result.length++];
+            entry = Entry{address, instruction, false};
+
+            if (get_opType(op) == Unknown || op == 0b1100111U /* jalr */) {
+                result.wait = true;
+                result.next_PC = address + 4;
+                break;
+            }
+            if (op == 0b1101111U) { /* jal */
+                result.next_PC = address + get_imm(instruction);
+                break;
+            }
+            if (op == 0b1100011U) { /* branch */
+                entry.branched = predict_branch;
+                result.predicted = true;
+                result.next_PC =
+                    address + (entry.branched ? get_imm(instruction) : 4);
+                break;
+            }
+
+            address += 4;
+            result.next_PC = address;
+        }
+        result.next_PC &= 0xFFFFFFFEU;
+        return result;
+    }
+
+    // 取到 b 之后循环缓冲的状态
+    LoopTracker nextLoop(const Block &b) {
+        LoopTracker l = loop;
+        if (LoopSize == 0 || redirect.value().flag) {
+            return LoopTracker{};
+        }
+        if (!b.valid || b.length == 0) {
+            return l;
+        }
+        if (l.state == LoopStream) {
+            return b.from_loop ? l : LoopTracker{};
+        }
+
+        const Entry &first = b.entries[0];
+        const Entry &last = b.entries[b.length - 1];
+        bool backward = get_op(last.instruction) == 0b1100011U &&
+                        last.branched && b.next_PC <= last.PC &&
+                        (last.PC - b.next_PC) / 4 < LoopSize;
+
+        // 记录中的循环体接着上一块取到了结尾的分支，并且再次跳回
+        if (l.state == LoopCapture &&
+            first.PC == l.start + 4 * l.captured &&
+            l.captured + b.length == l.length() && backward &&
+            last.PC == l.end && b.next_PC == l.start) {
+            return LoopTracker{LoopStream, l.start, l.end, l.length()};
+        }
+        // 新的候选循环，从下一块（跳回的循环头）开始记录
+        if (backward) {
+            return LoopTracker{LoopCapture, b.next_PC, last.PC, 0};
+        }
+        // 循环体中间的一块：取指没有在循环体内转向才能接着记录
+        if (l.state == LoopCapture &&
+            first.PC == l.start + 4 * l.captured &&
+            l.captured + b.length < l.length() && !b.wait &&
+            b.next_PC == last.PC + 4) {
+            l.captured += b.length;
+            return l;
+        }
+        return LoopTracker{};
+    }
+
+    void init() {
+        fetch_PC.reset(0);
+        waiting.reset(false);
+        head.reset(0);
+        count.reset(0);
+        loop.reset(LoopTracker{});
+        for (size_t i = 0; i < QueueSize; i++) {
+            PC_of[i] = 0;
+            instruction_of[i] = 0;
+            branched_of[i] = false;
+        }
+        for (size_t i = 0; i < (LoopSize > 0 ? LoopSize : 1); i++) {
+            loop_instruction_of[i] = 0;
+        }
+        latched_block = Block{};
+        latched_flush = false;
+        latched_loop = LoopTracker{};
+    }
+
+   public:
+    Wire<PCBus> redirect;  // 后端恢复时的取指地址，清空队列
+    Wire<PCBus> resume;    // 等待的 jalr 发射时算出的目标
+    Wire<size_t> issued;   // 本周期从队头发射走的指令数
+    // 本周期取指块中条件分支的地址与预测方向
+    Wire<uint32_t> branch_PC;
+    Wire<bool> predict_branch;
+
+    FetchUnit(const BaseMemory &mem) : mem(mem), occupancy(QueueSize + 1) {
+        init();
+        block = [&]() { return fetch(); };
+        branch_PC = [&]() -> uint32_t {
+            uint32_t address;
+            if (!start(address)) {
+                return 0;
+            }
+            bool from_loop = streaming(address);
+            size_t limit = room();
+            for (size_t i = 0; i < limit; i++, address += 4) {
+                uint8_t op = get_op(instructionAt(address, from_loop));
+                if (op == 0b1100011U) {
+                    return address;
+                }
+                if (op == 0b1101111U || op == 0b1100111U ||
+                    get_opType(op) == Unknown) {
+                    break;
+                }
+            }
+            return 0;
+        };
+
+        fetch_PC <= [&]() -> uint32_t {
+            const Block &b = block;
+            return b.valid ? b.next_PC : fetch_PC;
+        };
+        waiting <= [&]() -> bool {
+            const Block &b = block;
+            return b.valid ? b.wait : waiting;
+        };
+        head <= [&]() -> size_t {
+            if (redirect.value().flag) {
+                return head;
+            }
+            return (head + issued) % QueueSize;
+        };
+        count <= [&]() -> size_t {
+            size_t kept = redirect.value().flag ? 0 : count - issued;
+            return kept + block.value().length;
+        };
+        loop <= [&]() { return nextLoop(block); };
+    }
+
+    bool empty() const { return count == 0; }
+
+    size_t size() const { return count; }
+
+    // 队头起第 offset 条指令，offset 不小于 size() 时无意义
+    Entry peek(size_t offset) const {
+        size_t slot = (head + offset) % QueueSize;
+        return Entry{PC_of[slot], instruction_of[slot], branched_of[slot]};
+    }
+
+    Entry front() const { return peek(0); }
+
+    // 本周期取指块结尾用掉了预测的条件分支
+    BranchHistoryBus predicted() {
+        const Block &b = block;
+        if (!b.predicted) {
+            return BranchHistoryBus();
+        }
+        const Entry &last = b.entries[b.length - 1];
+        return BranchHistoryBus{true, last.PC, last.branched, 0};
+    }
+
+    void registerStats(StatRegistry &registry,
+                       const std::string &prefix) const {
+        registry.add(prefix + ".occupancy",
+                     "instructions in the fetch queue per cycle", occupancy);
+        registry.add(prefix + ".fetched", "instructions fetched",
+                     fetched_count);
+        registry.add(prefix + ".queue_full",
+                     "cycles fetch stopped on a full queue", queue_full_count);
+        registry.add(prefix + ".jalr_wait",
+                     "cycles fetch waited for a jalr target", jalr_wait_count);
+        registry.add(prefix + ".redirect", "fetch redirects from the back end",
+                     redirect_count);
+        // 读指令存储器与查分支预测器的次数，作为取指能耗的近似
+        registry.add(prefix + ".mem_reads",
+                     "instructions read from instruction memory",
+                     mem_read_count);
+        registry.add(prefix + ".predictor_lookups",
+                     "branch direction predictions requested", lookup_count);
+        if (LoopSize > 0) {
+            registry.add(prefix + ".loop_hits",
+                         "instructions replayed from the loop buffer",
+                         loop_hit_count);
+            registry.add(prefix + ".loop_coverage",
+                         "fraction of fetched instructions replayed",
+                         [&]() {
+                             return StatRegistry::ratio(loop_hit_count,
+                                                        fetched_count);
+                         });
+            registry.add(prefix + ".loop_locks",
+                         "loop bodies captured and locked in the loop buffer",
+                         loop_lock_count);
+            registry.add(prefix + ".loop_exit_mispredicts",
+                         "locked loops left by a mispredicted closing branch",
+                         loop_exit_count);
+        }
+    }
+
+    void pull() {
+        latched_flush = redirect.value().flag;
+        latched_block = block;
+        latched_loop = loop;
+
+        if (stats_enabled) {
+            const Block &b = latched_block;
+            // 锁定的循环结尾的分支预测跳转而实际没有跳转，后端转向它的下一条
+            PCBus relocate = redirect;
+            const LoopTracker &l = latched_loop;
+            occupancy.sample(count);
+            fetched_count += b.length;
+            queue_full_count += b.valid && room() == 0;
+            jalr_wait_count += !b.valid;
+            redirect_count += latched_flush;
+            mem_read_count += b.from_loop ? 0 : b.length;
+            lookup_count += b.predicted;
+            loop_hit_count += b.from_loop ? b.length : 0;
+            loop_exit_count += l.state == LoopStream && relocate.flag &&
+                               relocate.address == l.end &&
+                               relocate.offset == 4;
+        }
+
+        fetch_PC.pull();
+        waiting.pull();
+        head.pull();
+        count.pull();
+        loop.pull();
+    }
+
+    void update() {
+        // 新表项接在旧队尾之后；清空队列时从原队头处开始放
+        size_t tail = latched_flush ? size_t(head) : head + count;
+        for (size_t i = 0; i < latched_block.length; i++) {
+            size_t slot = (tail + i) % QueueSize;
+            const Entry &entry = latched_block.entries[i];
+            PC_of[slot] = entry.PC;
+            instruction_of[slot] = entry.instruction;
+            branched_of[slot] = entry.branched;
+
+            // 记录中的循环体按地址放进循环缓冲
+            if (latched_loop.state == LoopCapture &&
+                entry.PC >= latched_loop.start &&
+                entry.PC <= latched_loop.end) {
+                loop_instruction_of[(entry.PC - latched_loop.start) / 4] =
+                    entry.instruction;
+            }
+        }
+
+        fetch_PC.update();
+        waiting.update();
+        head.update();
+        count.update();
+        loop.update();
+
+        if (stats_enabled) {
+            const LoopTracker &l = loop;
+            loop_lock_count +=
+                latched_loop.state != LoopStream && l.state == LoopStream;
+        }
+    }
+
+    void reset() {
+        init();
+        occupancy.reset();
+        fetched_count.reset();
+        queue_full_count.reset();
+        jalr_wait_count.reset();
+        redirect_count.reset();
+        mem_read_count.reset();
+        lookup_count.reset();
+        loop_hit_count.reset();
+        loop_lock_count.reset();
+        loop_exit_count.reset();
+    }
+};
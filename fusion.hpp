@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+#include "utils.hpp"
+
+// 取指队列头部相邻的两条指令可以融合成一个内部操作，只占一个 ROB 表项、一个
+// 发射队列表项和一次 CDB 广播。融合对的第二条指令存进 ROB，第一条一同记下，
+// 提交时仍算作两条指令
+enum FusionIdiom : unsigned {
+    FuseNone = 0,
+    // lui rd, hi; addi rd, rd, lo：发射时即得到常量
+    FuseLuiAddi = 1U << 0,
+    // auipc rd, hi; jalr rd, lo(rd)：发射时即知道目标，不必等 jalr 提交检查
+    FuseAuipcJalr = 1U << 1,
+    // slt[i][u] rd, ...; beq/bne rd, x0：比较结果既写 rd 又决定分支方向
+    FuseCompareBranch = 1U << 2,
+    FuseAll = FuseLuiAddi | FuseAuipcJalr | FuseCompareBranch,
+};
+
+// first、second 组成 enabled 中的哪一种融合对，不能融合时返回 FuseNone
+inline FusionIdiom fusionOf(uint32_t first, uint32_t second,
+                            unsigned enabled) {
+    uint8_t op1 = get_op(first);
+    uint8_t op2 = get_op(second);
+    uint8_t rd = get_rd(first);
+    if (rd == 0) {
+        return FuseNone;
+    }
+
+    if ((enabled & FuseLuiAddi) && op1 == 0b0110111U /* lui */ &&
+        op2 == 0b0010011U && get_subop(second) == 0b000 /* addi */ &&
+        get_rd(second) == rd && get_rs1(second) == rd) {
+        return FuseLuiAddi;
+    }
+
+    if ((enabled & FuseAuipcJalr) && op1 == 0b0010111U /* auipc */ &&
+        op2 == 0b1100111U /* jalr */ && get_rd(second) == rd &&
+        get_rs1(second) == rd) {
+        return FuseAuipcJalr;
+    }
+
+    // R 型要排除 funct7 为 1 的 mulhsu、mulhu
+    if ((enabled & FuseCompareBranch) &&
+        (op1 == 0b0010011U || (op1 == 0b0110011U && (first >> 25) == 0)) &&
+        (get_subop(first) == 0b010 || get_subop(first) == 0b011) &&
+        op2 == 0b1100011U && get_subop(second) <= 0b001 /* beq, bne */ &&
+        ((get_rs1(second) == rd && get_rs2(second) == 0) ||
+         (get_rs1(second) == 0 && get_rs2(second) == rd))) {
+        return FuseCompareBranch;
+    }
+
+    return FuseNone;
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "ROB.hpp"
+#include "bus.hpp"
+#include "predictor.hpp"
+#include "stats.hpp"
+#include "utils.hpp"
+
+// store-wait 访存相关预测器：以 load 的 PC 索引一位，置位的 load 要等所有更老的
+// store 地址已知后才能分派，其余 load 可以越过地址未知的 store 推测执行。
+// store 的地址在 CDB 上广播时检查已经执行的更新的 load，字节重叠即为违例，
+// 从最老的违例 load 处重新执行并置位它的表项。表每 ClearInterval 周期清空一次
+// （0 表示从不清空），以免 load 一旦违例就永远等待
+template <size_t ROBLength, size_t Ports, size_t Bits = 10,
+          size_t ClearInterval = 16384>
+    requires(Ports > 0 && Bits <= 24)
+class MemDependencePredictor : public Updatable {
+    PackedTable<1> wait_table;
+    size_t cycles;  // 距上次清空的周期数
+
+    // 按 ROB 下标记录已经执行的 load 的地址与访问模式
+    bool issued[ROBLength + 1];
+    uint32_t address[ROBLength + 1];
+    uint8_t mode[ROBLength + 1];
+
+    // 仅用于统计：被预测器挡住的 load 及其地址与访问模式，以及它等待期间
+    // 是否有重叠的 store 解析。与上面违例检查用的数组分开，统计不影响时序
+    bool held[ROBLength + 1];
+    uint32_t held_address[ROBLength + 1];
+    uint8_t held_mode[ROBLength + 1];
+    bool dependent[ROBLength + 1];
+
+    const ReorderBuffer<ROBLength> &rob;
+
+    StatCounter speculative_count;
+    StatCounter wait_count;
+    StatCounter violation_count;
+    StatCounter false_dependence_count;
+
+    // pull 时锁存，update 时写入
+    MemBus latched_load[Ports];
+    size_t latched_allocate;
+
+    size_t tableIndex(uint32_t PC) const {
+        return (PC >> 2) & ((1U << Bits) - 1);
+    }
+
+    static uint8_t width(uint8_t mode) {
+        return mode & 0b010U ? 4 : mode & 0b001U ? 2 : 1;
+    }
+
+    static bool overlap(uint32_t address1, uint8_t mode1, uint32_t address2,
+                        uint8_t mode2) {
+        return address1 < address2 + width(mode2) &&
+               address2 < address1 + width(mode1);
+    }
+
+    bool live(size_t index) const { return rob.age(index) < rob.size(); }
+
+    // 本周期在 CDB 上解析地址的 store，没有则 reorder_index 为 0
+    CommonDataBus resolvedStore() {
+        CommonDataBus local_cdb = cdb;
+        if (local_cdb.reorder_index == 0 ||
+            !rob.getItem(local_cdb.reorder_index).is_store()) {
+            return CommonDataBus();
+        }
+        return local_cdb;
+    }
+
+    size_t findViolation() {
+        CommonDataBus store = resolvedStore();
+        if (store.reorder_index == 0) {
+            return 0;
+        }
+
+        uint8_t store_mode = rob.getItem(store.reorder_index).subop();
+        size_t store_age = rob.age(store.reorder_index);
+        size_t result = 0;
+        for (size_t i = 1; i <= ROBLength; i++) {
+            if (!issued[i] || !live(i) || rob.age(i) <= store_age) continue;
+            if (!overlap(store.data, store_mode, address[i], mode[i])) continue;
+            if (result == 0 || rob.age(i) < rob.age(result)) {
+                result = i;
+            }
+        }
+        return result;
+    }
+
+    void init() {
+        wait_table.reset();
+        cycles = 0;
+        for (size_t i = 0; i <= ROBLength; i++) {
+            issued[i] = false;
+            held[i] = false;
+            dependent[i] = false;
+        }
+        for (auto &load : latched_load) {
+            load = MemBus();
+        }
+        latched_allocate = 0;
+    }
+
+   public:
+    Wire<CommonDataBus> cdb;
+    Wire<MemBus> load[Ports];  // 本周期从各读口分派的 load
+    Wire<size_t> allocate;     // 本周期分配的 ROB 下标，0 表示没有
+    // 最老的违例 load 的 ROB 下标，0 表示没有
+    Wire<size_t> violation;
+
+    MemDependencePredictor(const ReorderBuffer<ROBLength> &rob)
+        : wait_table(1U << Bits), rob(rob) {
+        init();
+        violation = [&]() { return findViolation(); };
+    }
+
+    // PC 处的 load 是否要等所有更老的 store 地址已知
+    bool shouldWait(uint32_t PC) const {
+        return wait_table.get(tableIndex(PC));
+    }
+
+    // 统计用：本周期 index 处的 load 仅因预测要等待而没有分派
+    void hold(size_t index, uint32_t load_address, uint8_t load_mode) {
+        held[index] = true;
+        held_address[index] = load_address;
+        held_mode[index] = load_mode;
+    }
+
+    void registerStats(StatRegistry &registry,
+                       const std::string &prefix) const {
+        registry.add(prefix + ".speculative",
+                     "loads issued before an older store address was known",
+                     speculative_count);
+        registry.add(prefix + ".wait",
+                     "loads issued after the predictor held them back",
+                     wait_count);
+        registry.add(prefix + ".violation",
+                     "load replays on a memory ordering violation",
+                     violation_count);
+        registry.add(prefix + ".false_dependence",
+                     "held loads that no older store overlapped",
+                     false_dependence_count);
+    }
+
+    void pull() {
+        for (size_t port = 0; port < Ports; port++) {
+            latched_load[port] = load[port];
+        }
+        latched_allocate = allocate;
+
+        size_t violated = violation;
+        if (violated != 0) {
+            wait_table.stage(tableIndex(rob.getItem(violated).PC), 1);
+        }
+
+        if (stats_enabled) {
+            violation_count += violated != 0;
+
+            CommonDataBus store = resolvedStore();
+            if (store.reorder_index != 0) {
+                uint8_t store_mode = rob.getItem(store.reorder_index).subop();
+                size_t store_age = rob.age(store.reorder_index);
+                for (size_t i = 1; i <= ROBLength; i++) {
+                    if (held[i] && live(i) && rob.age(i) > store_age &&
+                        overlap(store.data, store_mode, held_address[i],
+                                held_mode[i])) {
+                        dependent[i] = true;
+                    }
+                }
+            }
+
+            for (const MemBus &lb : latched_load) {
+                if (lb.reorder_index == 0) continue;
+                if (held[lb.reorder_index]) {
+                    ++wait_count;
+                } else {
+                    speculative_count += !rob.storesResolved(lb.reorder_index);
+                }
+                false_dependence_count +=
+                    held[lb.reorder_index] && !dependent[lb.reorder_index];
+            }
+        }
+    }
+
+    void update() {
+        if (latched_allocate != 0) {
+            issued[latched_allocate] = false;
+            held[latched_allocate] = false;
+            dependent[latched_allocate] = false;
+        }
+        for (const MemBus &lb : latched_load) {
+            if (lb.reorder_index == 0) continue;
+            issued[lb.reorder_index] = true;
+            address[lb.reorder_index] = lb.address;
+            mode[lb.reorder_index] = lb.mode;
+        }
+
+        wait_table.update();
+        if (ClearInterval != 0 && ++cycles == ClearInterval) {
+            wait_table.reset();
+            cycles = 0;
+        }
+    }
+
+    void reset() {
+        init();
+        speculative_count.reset();
+        wait_count.reset();
+        violation_count.reset();
+        false_dependence_count.reset();
+    }
+};
@@ -1,39 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <format>
 #include <iostream>
 #include <map>
 #include <random>
 #include <stdexcept>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "bus.hpp"
+#include "miss_class.hpp"
+#include "stats.hpp"
+#include "tag_match.hpp"
 #include "utils.hpp"
 
 class BaseMemory : public CDBSource {
+   protected:
+    std::map<uint32_t, uint8_t> mems;
+
+    // 按读取模式截取并扩展读出的字
+    static uint32_t extend(uint32_t got, uint8_t mode) {
+        switch (mode) {
+            case 0b000U:
+                return sext<8>(got & 0x000000FFU);
+            case 0b001U:
+                return sext<16>(got & 0x0000FFFFU);
+            case 0b100U:
+                return got & 0x000000FFU;
+            case 0b101U:
+                return got & 0x0000FFFFU;
+        }
+        return got;
+    }
+
    public:
+    // 读口 read_bus[0..read_ports) 由各子类按端口数给出
     Wire<CommonDataBus> cdb;
-    Wire<MemBus> read_bus;
     Wire<MemBus> write_bus;
-    Wire<uint32_t> PC;
     Wire<bool> clear;
+    Wire<SquashBus> squash;
 
-    virtual uint32_t get_instruction() const = 0;
+    // 读口 port 正在处理读请求，本周期不能接收新的请求
+    virtual bool is_busy(size_t port) const = 0;
+    // 本周期写口能否写 address，读请求优先使用存储体
+    virtual bool can_write(uint32_t address) = 0;
     virtual MemoryStatistics memoryStatistics() const = 0;
+    virtual void registerStats(StatRegistry &registry,
+                               const std::string &prefix) const = 0;
+
+    // 取指直接读内存，不经过数据缓存，也不会为没有写过的地址分配存储
+    uint32_t get_instruction(uint32_t address) const {
+        uint32_t ret = 0;
+        for (size_t i = 0; i < 4; i++) {
+            auto it = mems.find(address + i);
+            if (it != mems.end()) {
+                ret |= uint32_t(it->second) << (8 * i);
+            }
+        }
+        return ret;
+    }
+
+    // 清空内存并读入程序，格式为 "@地址" 与逐字节的十六进制数
+    void load(std::istream &program) {
+        mems.clear();
+
+        uint32_t address = 0;
+        std::string buffer;
+        while (program >> buffer) {
+            if (buffer[0] == '@') {
+                address = stoul(buffer.substr(1, buffer.size()), nullptr, 16);
+            } else {
+                uint8_t t = std::stoul(buffer, nullptr, 16);
+                mems[address] = t;
+                address++;
+            }
+        }
+    }
 };
 
-template <size_t DELAY>
+// 各读口互不干扰，每个端口同时只处理一个请求
+template <size_t DELAY, size_t Ports = 1>
+    requires(Ports > 0)
 class Memory : public Updatable, public BaseMemory {
-    std::map<uint32_t, uint8_t> mems;
+    Reg<size_t> reorder_index[Ports];
+    Reg<size_t> remain_delay[Ports];
+    Reg<uint32_t> out[Ports];
 
-    Reg<size_t> reorder_index;
-    Reg<size_t> remain_delay;
-    Reg<uint32_t> instruction;
-    Reg<uint32_t> out;
-
-    Reg<size_t> read_count;
-    Reg<size_t> write_count;
+    StatCounter read_count;
+    StatCounter write_count;
+    StatCounter port_read_count[Ports];
+    StatCounter port_busy_count[Ports];
 
     Reg<MemBus> write_bus_reg;
 
@@ -47,122 +109,99 @@ class Memory : public Updatable, public BaseMemory {
     }
 
    public:
+    static constexpr size_t read_ports = Ports;
+
+    Wire<MemBus> read_bus[Ports];
+
     Memory() {
-        instruction <= LAM(get(PC));
         write_bus_reg <= LAM(write_bus);
-        remain_delay <= [&]() -> size_t {
-            if (clear) {
-                return 0;
-            }
-
-            MemBus rb = read_bus;
-            if (rb.reorder_index != 0 && reorder_index == 0) {
-                return DELAY;
-            }
-            return remain_delay > 0 ? remain_delay - 1 : 0;
-        };
-        read_count <= [&]() -> size_t {
-            if (!clear && reorder_index == 0 &&
-                read_bus.value().reorder_index != 0) {
-                return read_count + 1;
-            }
-            return read_count;
-        };
-        write_count <= [&]() -> size_t {
-            if (!clear && write_bus.value().reorder_index != 0) {
-                return write_count + 1;
-            }
-            return write_count;
-        };
-        reorder_index <= [&]() -> size_t {
-            if (clear) {
-                return 0;
-            }
 
-            if (reorder_index != 0) {
-                if (cdb.value().reorder_index == reorder_index) {
+        for (size_t port = 0; port < Ports; port++) {
+            remain_delay[port] <= [&, port]() -> size_t {
+                if (clear) {
                     return 0;
                 }
-            } else {
-                MemBus rb = read_bus;
-                if (rb.reorder_index != 0) {
-                    return rb.reorder_index;
-                }
-            }
 
-            return reorder_index;
-        };
-        out <= [&]() -> uint32_t {
-            if (clear) {
-                return 0;
-            }
+                MemBus rb = read_bus[port];
+                if (rb.reorder_index != 0 && reorder_index[port] == 0) {
+                    return DELAY;
+                }
+                return remain_delay[port] > 0 ? remain_delay[port] - 1 : 0;
+            };
+            reorder_index[port] <= [&, port]() -> size_t {
+                if (clear || squash.value().younger(reorder_index[port])) {
+                    return 0;
+                }
 
-            MemBus rb = read_bus;
-            if (rb.reorder_index != 0 && reorder_index == 0) {
-                uint32_t got = get(rb.address);
-                switch (rb.mode) {
-                    case 0b000U:
-                        return sext<8>(got & 0x000000FFU);
-                    case 0b001U:
-                        return sext<16>(got & 0x0000FFFFU);
-                    case 0b010U:
-                        return got;
-                    case 0b100U:
-                        return got & 0x000000FFU;
-                    case 0b101U:
-                        return got & 0x0000FFFFU;
+                if (reorder_index[port] != 0) {
+                    if (cdb.value().reorder_index == reorder_index[port]) {
+                        return 0;
+                    }
+                } else {
+                    MemBus rb = read_bus[port];
+                    if (rb.reorder_index != 0) {
+                        return rb.reorder_index;
+                    }
                 }
-            }
-            return out;
-        };
 
-        uint32_t address = 0;
-        std::string buffer;
-        while (!std::cin.eof()) {
-            std::cin >> buffer;
-            if (buffer.empty()) continue;
+                return reorder_index[port];
+            };
+            out[port] <= [&, port]() -> uint32_t {
+                if (clear) {
+                    return 0;
+                }
 
-            if (buffer[0] == '@') {
-                address = stoul(buffer.substr(1, buffer.size()), nullptr, 16);
-            } else {
-                uint8_t t = std::stoul(buffer, nullptr, 16);
-                mems[address] = t;
-                address++;
-            }
+                MemBus rb = read_bus[port];
+                if (rb.reorder_index != 0 && reorder_index[port] == 0) {
+                    return extend(rb.forwarded ? rb.input : get(rb.address),
+                                  rb.mode);
+                }
+                return out[port];
+            };
         }
     }
 
-    uint32_t get_instruction() const { return instruction; }
+    bool is_busy(size_t port) const { return reorder_index[port] != 0; }
+
+    bool can_write(uint32_t) { return true; }
 
     CommonDataBus CDBOut() const {
-        return remain_delay == 0 ? CommonDataBus{reorder_index, out}
-                                 : CommonDataBus();
+        for (size_t port = 0; port < Ports; port++) {
+            if (reorder_index[port] != 0 && remain_delay[port] == 0) {
+                return CommonDataBus{reorder_index[port], out[port], 0};
+            }
+        }
+        return CommonDataBus();
     }
 
     void pull() {
-        reorder_index.pull();
-        remain_delay.pull();
-        instruction.pull();
-        out.pull();
         write_bus_reg.pull();
+        for (size_t port = 0; port < Ports; port++) {
+            reorder_index[port].pull();
+            remain_delay[port].pull();
+            out[port].pull();
+        }
 
-#ifdef PROFILE
-        read_count.pull();
-        write_count.pull();
-#endif
+        if (stats_enabled && !clear) {
+            for (size_t port = 0; port < Ports; port++) {
+                MemBus rb = read_bus[port];
+                bool accepted =
+                    reorder_index[port] == 0 && rb.reorder_index != 0;
+                read_count += accepted && !rb.forwarded;
+                port_read_count[port] += accepted;
+                port_busy_count[port] += accepted || reorder_index[port] != 0;
+            }
+            write_count += write_bus.value().reorder_index != 0;
+        }
     }
 
     void update() {
-        reorder_index.update();
-        remain_delay.update();
-        instruction.update();
-        out.update();
         write_bus_reg.update();
-
-#ifdef PROFILE
-        read_count.update();
-        write_count.update();
-#endif
+        for (size_t port = 0; port < Ports; port++) {
+            reorder_index[port].update();
+            remain_delay[port].update();
+            out[port].update();
+        }
 
         MemBus wb = write_bus_reg;
         if (wb.reorder_index != 0) {
@@ -177,52 +216,102 @@ class Memory : public Updatable, public BaseMemory {
         }
     }
 
+    void reset() {
+        mems.clear();
+        for (size_t port = 0; port < Ports; port++) {
+            reorder_index[port].reset();
+            remain_delay[port].reset();
+            out[port].reset();
+            port_read_count[port].reset();
+            port_busy_count[port].reset();
+        }
+        write_bus_reg.reset();
+        read_count.reset();
+        write_count.reset();
+    }
+
     MemoryStatistics memoryStatistics() const {
-        return MemoryStatistics{read_count, write_count, 0};
+        return MemoryStatistics{read_count, write_count, 0, 0, 0, 0};
+    }
+
+    void registerStats(StatRegistry &registry,
+                       const std::string &prefix) const {
+        registry.add(prefix + ".read", "loads sent to memory", read_count);
+        registry.add(prefix + ".write", "stores written to memory",
+                     write_count);
+        for (size_t port = 0; port < Ports; port++) {
+            std::string name = std::format("{}.port{}", prefix, port);
+            registry.add(name + ".read", "loads accepted by the port",
+                         port_read_count[port]);
+            registry.add(name + ".busy", "cycles the port held a load",
+                         port_busy_count[port]);
+        }
     }
 };
 
-template <size_t s, size_t E, size_t b, size_t CacheDelay, size_t MemoryDelay>
-    requires(b > 0 && s + b <= 32 && E > 0)
+// Ports 个读口共享一个按缓存行交错分为 Banks 个体的数据缓存。每个体每周期只能
+// 被访问一次，读口按编号依次占用，写口只使用没有读请求的体；体被占用的读请求
+// 在端口上等待下一周期再试（体冲突）。缺失时在访问当周期填充缓存行，读出的数据暂存在
+// 端口中，等待 CacheDelay 或 MemoryDelay 周期后广播。
+// Victims 不为 0 时，组中被替换出去的行放进一个 Victims 项的全相联受害者缓存，
+// 组中缺失而受害者缓存命中的读请求等待 VictimDelay 周期，并把这一行换回组中
+template <size_t s, size_t E, size_t b, size_t CacheDelay, size_t MemoryDelay,
+          size_t Ports = 1, size_t Banks = 1, size_t Victims = 0,
+          size_t VictimDelay = CacheDelay + 1>
+    requires(b > 0 && s + b <= 32 && E > 0 && Ports > 0 && Banks > 0 &&
+             (Banks & (Banks - 1)) == 0 && Banks <= (1 << s))
 class CacheMemory : public Updatable, public BaseMemory {
     constexpr static size_t S = 1 << s;
     constexpr static size_t B = 1 << b;
     constexpr static size_t t = 32 - s - b;
 
-    struct CacheItem {
-        bool valid;
-        uint32_t mark;  // 只用它的后 t 位
-        uint8_t data[B];
-
-        uint32_t get(uint32_t lower_address, uint8_t mode) const {
-            uint32_t ret = 0;
-            ret = data[lower_address];
-            if (mode & 0b011U) {
-                ret |= data[lower_address + 1] << 8;
-                if (mode & 0b010U) {
-                    ret |= data[lower_address + 2] << 16;
-                    ret |= data[lower_address + 3] << 24;
-                }
-            }
-            return ret;
-        }
-    };
-
-    struct CacheGroup {
-        Reg<CacheItem> items[E];
+    // 第 group * E + way 行的打包标记（见 packTag，0 为无效）与数据。缓存行只在
+    // 填充或写入时原地修改，本周期的填充与写入在 pull 时锁存，update 时才写入
+    std::vector<uint32_t> tags;
+    std::vector<uint8_t> lines;  // 每行 B 字节
+
+    // 受害者缓存各项的标记（packTag(行地址)，0 为无效）与数据，
+    // 没有空闲项时按 victim_next 轮流替换
+    std::vector<uint32_t> victim_tags;
+    std::vector<uint8_t> victim_lines;
+    size_t victim_next;
+
+    // 默认值 Fill{} 表示没有填充
+    struct Fill {
+        size_t line = S * E;  // S * E 表示没有填充
+        uint32_t tag = 0;
+        uint32_t address = 0;
+        // 从受害者缓存的这一项换回，Victims 表示从内存读
+        size_t victim = Victims;
     };
-
-    std::map<uint32_t, uint8_t> mems;
-    CacheGroup groups[S];
+    Fill latched_fill[Ports];
+    MemBus latched_write;
 
     Reg<MemBus> write_bus_reg;
-    Reg<MemBus> read_bus_reg;
-    Reg<uint32_t> instruction;
-    Reg<size_t> remain_delay;
 
-    Reg<size_t> read_count;
-    Reg<size_t> write_count;
-    Reg<size_t> read_cache_hit_count;
+    // 每个读口：接收的请求、是否因体冲突仍在等待访问、剩余延迟、读出的数据
+    Reg<MemBus> read_bus_reg[Ports];
+    Reg<bool> waiting[Ports];
+    Reg<size_t> remain_delay[Ports];
+    Reg<uint32_t> out[Ports];
+
+    // 本周期真正访问缓存的请求，没有访问的端口 reorder_index 为 0
+    Wire<std::array<MemBus, Ports>> access;
+    // 每个 access 的查找结果，每周期只算一次，供延迟、读数、填充与统计共用
+    Wire<std::array<std::pair<bool, size_t>, Ports>> lookup;
+    // 组中缺失的 access 在受害者缓存中命中的项，Victims 表示没有命中
+    Wire<std::array<size_t, Ports>> victim_lookup;
+
+    StatCounter read_count;
+    StatCounter write_count;
+    StatCounter read_cache_hit_count;
+    StatCounter bank_conflict_count;
+    StatCounter victim_hit_count;
+    StatCounter victim_insert_count;
+    StatCounter port_read_count[Ports];
+    StatCounter port_busy_count[Ports];
+    // 与组相联部分同容量（不含受害者缓存）的影子缓存
+    MissClassifier miss_classifier;
 
     std::mt19937 rng;
     std::uniform_int_distribution<> replace_selector;
@@ -241,40 +330,124 @@ class CacheMemory : public Updatable, public BaseMemory {
         return (address >> b) & (S - 1);
     }
 
+    uint32_t getBank(uint32_t address) const {
+        return (address >> b) & (Banks - 1);
+    }
+
     uint32_t getMark(uint32_t address) const { return address >> (s + b); }
 
     uint32_t getLowerAddress(uint32_t address) const {
         return address & (B - 1);
     }
 
+    size_t lineIndex(uint32_t group_index, size_t item_index) const {
+        return group_index * E + item_index;
+    }
+
+    static uint32_t lineGet(const uint8_t *data, uint32_t lower_address,
+                            uint8_t mode) {
+        uint32_t ret = 0;
+        ret = data[lower_address];
+        if (mode & 0b011U) {
+            ret |= data[lower_address + 1] << 8;
+            if (mode & 0b010U) {
+                ret |= data[lower_address + 2] << 16;
+                ret |= data[lower_address + 3] << 24;
+            }
+        }
+        return ret;
+    }
+
     // 当能找到时，返回 {true, index}；当找不到时，返回 {false, 用于替换的地址}
     std::pair<bool, size_t> findInGroup(uint32_t group_index,
                                         uint32_t mark) const {
-        for (size_t item_index = 0; item_index < E; item_index++) {
-            const CacheItem &item = groups[group_index].items[item_index];
-            if (item.valid && item.mark == mark) {
-                return {true, item_index};
-            }
+        TagMatch match =
+            matchTags(&tags[lineIndex(group_index, 0)], E, packTag(mark));
+        if (match.hit != E) {
+            return {true, match.hit};
+        }
+        if (match.free != E) {
+            return {false, match.free};
         }
+        return {false, random_index};
+    }
+
+    std::array<std::pair<bool, size_t>, Ports> lookupAll() {
+        std::array<std::pair<bool, size_t>, Ports> result{};
+        const std::array<MemBus, Ports> &requests = access;
+        for (size_t port = 0; port < Ports; port++) {
+            const MemBus &request = requests[port];
+            if (request.reorder_index == 0 || request.forwarded) continue;
+            result[port] = findInGroup(getGroupIndex(request.address),
+                                       getMark(request.address));
+        }
+        return result;
+    }
+
+    std::array<size_t, Ports> victimLookupAll() {
+        std::array<size_t, Ports> result;
+        result.fill(Victims);
+        if (Victims == 0) {
+            return result;
+        }
+        const std::array<MemBus, Ports> &requests = access;
+        for (size_t port = 0; port < Ports; port++) {
+            const MemBus &request = requests[port];
+            if (request.reorder_index == 0 || request.forwarded ||
+                lookup.value()[port].first)
+                continue;
+            result[port] = matchTags(victim_tags.data(), Victims,
+                                     packTag(request.address >> b))
+                               .hit;
+        }
+        return result;
+    }
 
-        for (size_t item_index = 0; item_index < E; item_index++) {
-            const CacheItem &item = groups[group_index].items[item_index];
-            if (!item.valid) {
-                return {false, item_index};
+    // 组中第 line 行被替换时放进受害者缓存，from 为换回组中的项
+    void evict(size_t line, size_t from) {
+        if (Victims == 0) {
+            return;
+        }
+        size_t slot = from;
+        if (slot == Victims) {
+            if (tags[line] == 0) {
+                return;
+            }
+            TagMatch match = matchTags(victim_tags.data(), Victims, 0);
+            slot = match.hit;
+            if (slot == Victims) {
+                slot = victim_next;
+                victim_next = (victim_next + 1) % Victims;
             }
         }
 
-        return {false, random_index};
+        uint32_t line_address = ((tags[line] >> 1) << s) | (line / E);
+        victim_tags[slot] = tags[line] == 0 ? 0 : packTag(line_address);
+        std::swap_ranges(&lines[line * B], &lines[line * B] + B,
+                         &victim_lines[slot * B]);
+        victim_insert_count += stats_enabled && tags[line] != 0;
     }
 
-    void load_data(uint32_t address, CacheItem &item) {
+    void load_data(uint32_t address, size_t line) {
         uint32_t start_address = address & (~(B - 1));
 
         for (size_t i = 0; i < B; i++) {
-            item.data[i] = mems[start_address + i];
+            lines[line * B + i] = mems[start_address + i];
         }
     }
 
+    void clearLines() {
+        tags.assign(S * E, 0);
+        lines.assign(S * E * B, 0);
+        victim_tags.assign(Victims, 0);
+        victim_lines.assign(Victims * B, 0);
+        victim_next = 0;
+        for (auto &fill : latched_fill) {
+            fill = Fill{};
+        }
+        latched_write = MemBus();
+    }
+
     void checkBound(uint32_t lower_address, uint8_t mode) const {
         size_t offset = 0;
         if (mode & 0b010U) {
@@ -290,159 +463,158 @@ class CacheMemory : public Updatable, public BaseMemory {
         }
     }
 
+    // 端口本周期想要访问缓存的请求：空闲端口上新到的请求或上周期体冲突的请求
+    MemBus pending(size_t port) {
+        const MemBus &rbr = read_bus_reg[port];
+        if (rbr.reorder_index == 0) {
+            return read_bus[port];
+        }
+        return waiting[port] ? rbr : MemBus();
+    }
+
+    std::array<MemBus, Ports> arbitrate() {
+        std::array<MemBus, Ports> result{};
+        if (clear) {
+            return result;
+        }
+
+        bool bank_used[Banks] = {};
+
+        for (size_t port = 0; port < Ports; port++) {
+            MemBus request = pending(port);
+            if (request.reorder_index == 0) continue;
+
+            // 转发的数据不需要访问缓存
+            if (request.forwarded) {
+                result[port] = request;
+                continue;
+            }
+
+            auto bank = getBank(request.address);
+            if (!bank_used[bank]) {
+                bank_used[bank] = true;
+                result[port] = request;
+            }
+        }
+        return result;
+    }
+
    public:
-    CacheMemory() : replace_selector(0, E - 1) {
-        instruction <= LAM(direct_get(PC));
+    static constexpr size_t read_ports = Ports;
+
+    Wire<MemBus> read_bus[Ports];
+
+    CacheMemory() : miss_classifier(S * E), replace_selector(0, E - 1) {
+        clearLines();
         write_bus_reg <= LAM(write_bus);
         random_index <= LAM(replace_selector(rng));
-        read_bus_reg <= [&]() -> MemBus {
-            CommonDataBus fetched_cdb = cdb;
-            MemBus old_read_bus_reg = read_bus_reg;
-            if (fetched_cdb.reorder_index != 0 &&
-                fetched_cdb.reorder_index == old_read_bus_reg.reorder_index) {
-                old_read_bus_reg.reorder_index = 0;
-                return old_read_bus_reg;
-            }
+        access = [&]() { return arbitrate(); };
+        lookup = [&]() { return lookupAll(); };
+        victim_lookup = [&]() { return victimLookupAll(); };
+
+        for (size_t port = 0; port < Ports; port++) {
+            read_bus_reg[port] <= [&, port]() -> MemBus {
+                MemBus old_read_bus_reg = read_bus_reg[port];
+                if (clear ||
+                    squash.value().younger(old_read_bus_reg.reorder_index)) {
+                    return MemBus();
+                }
 
-            if (old_read_bus_reg.reorder_index == 0) {
-                return read_bus;
-            }
+                CommonDataBus fetched_cdb = cdb;
+                if (fetched_cdb.reorder_index != 0 &&
+                    fetched_cdb.reorder_index ==
+                        old_read_bus_reg.reorder_index) {
+                    return MemBus();
+                }
 
-            return read_bus_reg;
-        };
-
-        for (size_t group_index = 0; group_index < S; group_index++) {
-            for (size_t item_index = 0; item_index < E; item_index++) {
-                Reg<CacheItem> &item = groups[group_index].items[item_index];
-
-                item <= [&, group_index, item_index]() -> CacheItem {
-                    MemBus rb = read_bus;
-                    MemBus wb = write_bus;
-                    MemBus rbr = read_bus_reg;
-
-                    CacheItem new_item = item;
-
-                    if (rb.reorder_index != 0 && rbr.reorder_index == 0 &&
-                        getGroupIndex(rb.address) == group_index) {
-                        auto target_mark = getMark(rb.address);
-                        auto result = findInGroup(group_index, target_mark);
-                        if (!result.first && result.second == item_index) {
-                            new_item.valid = true;
-                            new_item.mark = target_mark;
-                            load_data(rb.address, new_item);
-                        }
-                    }
+                if (old_read_bus_reg.reorder_index == 0) {
+                    return read_bus[port];
+                }
 
-                    if (new_item.valid && wb.reorder_index != 0 &&
-                        getGroupIndex(wb.address) == group_index &&
-                        getMark(wb.address) == new_item.mark) {
-                        uint32_t lower_address = getLowerAddress(wb.address);
-                        checkBound(lower_address, wb.mode);
-
-                        new_item.data[lower_address] = wb.input & 0xff;
-                        if (wb.mode & 0b011) {
-                            new_item.data[lower_address + 1] =
-                                (wb.input >> 8) & 0xff;
-                            if (wb.mode == 0b010) {
-                                new_item.data[lower_address + 2] =
-                                    (wb.input >> 16) & 0xff;
-                                new_item.data[lower_address + 3] =
-                                    (wb.input >> 24) & 0xff;
-                            }
-                        }
-                    }
+                return old_read_bus_reg;
+            };
 
-                    return new_item;
-                };
-            }
-        }
+            waiting[port] <= [&, port]() -> bool {
+                if (clear || squash.value().younger(
+                                 MemBus(read_bus_reg[port]).reorder_index)) {
+                    return false;
+                }
 
-        read_count <= [&]() -> size_t {
-            if (!clear && MemBus(read_bus_reg).reorder_index == 0 &&
-                read_bus.value().reorder_index != 0) {
-                return read_count + 1;
-            }
-            return read_count;
-        };
-        write_count <= [&]() -> size_t {
-            if (!clear && write_bus.value().reorder_index != 0) {
-                return write_count + 1;
-            }
-            return write_count;
-        };
-        read_cache_hit_count <= [&]() -> size_t {
-            const MemBus rb = read_bus;
-            auto target_group_index = getGroupIndex(rb.address);
-            auto target_mark = getMark(rb.address);
-            auto result = findInGroup(target_group_index, target_mark);
-
-            if (!clear && MemBus(read_bus_reg).reorder_index == 0 &&
-                rb.reorder_index != 0 && result.first) {
-                return read_cache_hit_count + 1;
-            }
-            return read_cache_hit_count;
-        };
+                return pending(port).reorder_index != 0 &&
+                       access.value()[port].reorder_index == 0;
+            };
 
-        remain_delay <= [&]() -> size_t {
-            if (clear) {
-                return 0;
-            }
+            remain_delay[port] <= [&, port]() -> size_t {
+                if (clear) {
+                    return 0;
+                }
 
-            MemBus rb = read_bus;
-            MemBus rbr = read_bus_reg;
-            if (rb.reorder_index != 0 && rbr.reorder_index == 0) {
-                auto target_group_index = getGroupIndex(rb.address);
-                auto target_mark = getMark(rb.address);
+                MemBus request = access.value()[port];
+                if (request.reorder_index != 0) {
+                    if (request.forwarded || lookup.value()[port].first) {
+                        return CacheDelay;
+                    }
+                    return victim_lookup.value()[port] != Victims
+                               ? VictimDelay
+                               : MemoryDelay;
+                }
 
-                return findInGroup(target_group_index, target_mark).first
-                           ? CacheDelay
-                           : MemoryDelay;
-            }
+                return remain_delay[port] > 0 ? remain_delay[port] - 1 : 0;
+            };
 
-            return remain_delay > 0 ? remain_delay - 1 : 0;
-        };
+            out[port] <= [&, port]() -> uint32_t {
+                MemBus request = access.value()[port];
+                if (request.reorder_index == 0) {
+                    return out[port];
+                }
+                if (request.forwarded) {
+                    return extend(request.input, request.mode);
+                }
 
-        uint32_t address = 0;
-        std::string buffer;
-        while (!std::cin.eof()) {
-            std::cin >> buffer;
-            if (buffer.empty()) continue;
+                uint32_t lower_address = getLowerAddress(request.address);
+                checkBound(lower_address, request.mode);
+
+                auto target_group_index = getGroupIndex(request.address);
+                auto result = lookup.value()[port];
+                const uint8_t *data;
+                if (result.first) {
+                    data = &lines[lineIndex(target_group_index,
+                                            result.second) *
+                                  B];
+                } else if (size_t victim = victim_lookup.value()[port];
+                           victim != Victims) {
+                    data = &victim_lines[victim * B];
+                } else {
+                    return extend(direct_get(request.address), request.mode);
+                }
+                return extend(lineGet(data, lower_address, request.mode),
+                              request.mode);
+            };
+        }
+    }
 
-            if (buffer[0] == '@') {
-                address = stoul(buffer.substr(1, buffer.size()), nullptr, 16);
-            } else {
-                uint8_t t = std::stoul(buffer, nullptr, 16);
-                mems[address] = t;
-                address++;
+    bool is_busy(size_t port) const {
+        return MemBus(read_bus_reg[port]).reorder_index != 0;
+    }
+
+    // 有读请求要访问同一个存储体时写口让路
+    bool can_write(uint32_t address) {
+        for (size_t port = 0; port < Ports; port++) {
+            MemBus request = pending(port);
+            if (request.reorder_index != 0 && !request.forwarded &&
+                getBank(request.address) == getBank(address)) {
+                return false;
             }
         }
+        return true;
     }
 
-    uint32_t get_instruction() const { return instruction; }
-
     CommonDataBus CDBOut() const {
-        if (remain_delay == 0) {
-            const MemBus &rbr = read_bus_reg;
-            if (rbr.reorder_index != 0) {
-                uint32_t lower_address = rbr.address & (B - 1);
-                checkBound(lower_address, rbr.mode);
-
-                auto target_group_index = getGroupIndex(rbr.address);
-                auto target_mark = getMark(rbr.address);
-                auto result = findInGroup(target_group_index, target_mark);
-
-                assert(result.first);
-
-                const CacheItem &item =
-                    groups[target_group_index].items[result.second];
-                uint32_t got = item.get(lower_address, rbr.mode);
-                if (rbr.mode == 0b000U) {
-                    got = sext<8>(got);
-                } else if (rbr.mode == 0b001U) {
-                    got = sext<16>(got);
-                }
-
-                return CommonDataBus{rbr.reorder_index, got};
+        for (size_t port = 0; port < Ports; port++) {
+            const MemBus &rbr = read_bus_reg[port];
+            if (rbr.reorder_index != 0 && !waiting[port] &&
+                remain_delay[port] == 0) {
+                return CommonDataBus{rbr.reorder_index, out[port], 0};
             }
         }
         return CommonDataBus{};
@@ -450,40 +622,112 @@ class CacheMemory : public Updatable, public BaseMemory {
 
     void pull() {
         write_bus_reg.pull();
-        read_bus_reg.pull();
-        instruction.pull();
-        remain_delay.pull();
         random_index.pull();
+        for (size_t port = 0; port < Ports; port++) {
+            read_bus_reg[port].pull();
+            waiting[port].pull();
+            remain_delay[port].pull();
+            out[port].pull();
+        }
 
-#ifdef PROFILE
-        read_count.pull();
-        write_count.pull();
-        read_cache_hit_count.pull();
-#endif
+        if (stats_enabled && !clear) {
+            for (size_t port = 0; port < Ports; port++) {
+                MemBus rb = read_bus[port];
+                bool idle = MemBus(read_bus_reg[port]).reorder_index == 0;
+                bool accepted = idle && rb.reorder_index != 0;
+                read_count += accepted && !rb.forwarded;
+                port_read_count[port] += accepted;
+                port_busy_count[port] += accepted || !idle;
+
+                MemBus request = pending(port);
+                if (request.reorder_index == 0 || request.forwarded) continue;
+                if (access.value()[port].reorder_index == 0) {
+                    ++bank_conflict_count;
+                } else {
+                    read_cache_hit_count += lookup.value()[port].first;
+                    victim_hit_count +=
+                        victim_lookup.value()[port] != Victims;
+                    miss_classifier.access(request.address >> b,
+                                           lookup.value()[port].first,
+                                           request.PC);
+                }
+            }
+            write_count += write_bus.value().reorder_index != 0;
+        }
 
-        for (auto &group : groups) {
-            for (auto &item : group.items) {
-                item.pull();
+        // 同一组属于同一个体，每周期至多一个读口访问
+        for (size_t port = 0; port < Ports; port++) {
+            MemBus request = access.value()[port];
+            latched_fill[port] = Fill{};
+            if (request.reorder_index == 0 || request.forwarded) continue;
+
+            auto result = lookup.value()[port];
+            if (!result.first) {
+                latched_fill[port] = Fill{
+                    lineIndex(getGroupIndex(request.address), result.second),
+                    packTag(getMark(request.address)), request.address,
+                    victim_lookup.value()[port]};
             }
         }
+
+        latched_write = write_bus;
+        if (latched_write.reorder_index != 0) {
+            checkBound(getLowerAddress(latched_write.address),
+                       latched_write.mode);
+        }
     }
 
     void update() {
         write_bus_reg.update();
-        read_bus_reg.update();
-        instruction.update();
-        remain_delay.update();
         random_index.update();
+        for (size_t port = 0; port < Ports; port++) {
+            read_bus_reg[port].update();
+            waiting[port].update();
+            remain_delay[port].update();
+            out[port].update();
+        }
 
-#ifdef PROFILE
-        read_count.update();
-        write_count.update();
-        read_cache_hit_count.update();
-#endif
+        // 先填充再写入，填充读的是写入本周期数据之前的内存。先处理从受害者
+        // 缓存换回的行，再为从内存填充的行腾出受害者缓存的项
+        for (const Fill &fill : latched_fill) {
+            if (fill.line == S * E || fill.victim == Victims) continue;
+            evict(fill.line, fill.victim);
+            tags[fill.line] = fill.tag;
+        }
+        for (const Fill &fill : latched_fill) {
+            if (fill.line == S * E || fill.victim != Victims) continue;
+            evict(fill.line, Victims);
+            tags[fill.line] = fill.tag;
+            load_data(fill.address, fill.line);
+        }
 
-        for (auto &group : groups) {
-            for (auto &item : group.items) {
-                item.update();
+        const MemBus &lw = latched_write;
+        if (lw.reorder_index != 0) {
+            auto group_index = getGroupIndex(lw.address);
+            auto result = findInGroup(group_index, getMark(lw.address));
+            // 写穿透：组中或受害者缓存中的副本同时更新
+            uint8_t *data = nullptr;
+            if (result.first) {
+                size_t line = lineIndex(group_index, result.second);
+                data = &lines[line * B + getLowerAddress(lw.address)];
+            } else if (Victims > 0) {
+                size_t victim = matchTags(victim_tags.data(), Victims,
+                                          packTag(lw.address >> b))
+                                    .hit;
+                if (victim != Victims) {
+                    data = &victim_lines[victim * B +
+                                         getLowerAddress(lw.address)];
+                }
+            }
+            if (data != nullptr) {
+                data[0] = lw.input & 0xff;
+                if (lw.mode & 0b011) {
+                    data[1] = (lw.input >> 8) & 0xff;
+                    if (lw.mode == 0b010) {
+                        data[2] = (lw.input >> 16) & 0xff;
+                        data[3] = (lw.input >> 24) & 0xff;
+                    }
+                }
             }
         }
 
@@ -500,7 +744,72 @@ class CacheMemory : public Updatable, public BaseMemory {
         }
     }
 
+    void reset() {
+        mems.clear();
+        clearLines();
+        write_bus_reg.reset();
+        for (size_t port = 0; port < Ports; port++) {
+            read_bus_reg[port].reset();
+            waiting[port].reset();
+            remain_delay[port].reset();
+            out[port].reset();
+            port_read_count[port].reset();
+            port_busy_count[port].reset();
+        }
+        rng.seed(std::mt19937::default_seed);
+        random_index.reset();
+        read_count.reset();
+        write_count.reset();
+        read_cache_hit_count.reset();
+        bank_conflict_count.reset();
+        victim_hit_count.reset();
+        victim_insert_count.reset();
+        miss_classifier.reset();
+    }
+
     MemoryStatistics memoryStatistics() const {
-        return MemoryStatistics{read_count, write_count, read_cache_hit_count};
+        return MemoryStatistics{read_count,
+                                write_count,
+                                read_cache_hit_count,
+                                miss_classifier.compulsoryCount(),
+                                miss_classifier.capacityCount(),
+                                miss_classifier.conflictCount()};
     }
-};
\ No newline at end of file
+
+    void registerStats(StatRegistry &registry,
+                       const std::string &prefix) const {
+        registry.add(prefix + ".read", "loads sent to the cache", read_count);
+        registry.add(prefix + ".write", "stores written to the cache",
+                     write_count);
+        registry.add(prefix + ".read_hit", "loads hitting in the cache",
+                     read_cache_hit_count);
+        registry.add(prefix + ".read_hit_ratio", "load hit ratio", [&]() {
+            return StatRegistry::ratio(read_cache_hit_count, read_count);
+        });
+        registry.add(prefix + ".bank_conflict",
+                     "load cycles lost to a busy cache bank",
+                     bank_conflict_count);
+        miss_classifier.registerStats(registry, prefix + ".miss");
+        if (Victims > 0) {
+            registry.add(prefix + ".victim_hit",
+                         "loads missing the sets but hitting the victim cache",
+                         victim_hit_count);
+            registry.add(prefix + ".victim_hit_ratio",
+                         "victim cache hit ratio of set misses", [&]() {
+                             return StatRegistry::ratio(
+                                 victim_hit_count,
+                                 read_count - read_cache_hit_count);
+                         });
+            registry.add(prefix + ".victim_insert",
+                         "evicted lines moved into the victim cache",
+                         victim_insert_count);
+        }
+        for (size_t port = 0; port < Ports; port++) {
+            std::string name = std::format("{}.port{}", prefix, port);
+            registry.add(name + ".read", "loads accepted by the port",
+                         port_read_count[port]);
+            registry.add(name + ".busy", "cycles the port held a load",
+                         port_busy_count[port]);
+        }
+    }
+};
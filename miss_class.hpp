@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "stats.hpp"
+
+// 按 3C 模型给缓存的读缺失分类：从未访问过的行是强制缺失；容量相同的全相联
+// LRU 影子缓存也缺失的是容量缺失；其余只因组相联的映射冲突而缺失。
+// 只观察会分配缓存行的访问，不影响被观察的缓存
+class MissClassifier {
+   public:
+    enum Kind { Hit, Compulsory, Capacity, Conflict };
+
+   private:
+    size_t capacity;  // 影子缓存的行数
+
+    // 按行地址的首次访问位图，按需扩大
+    std::vector<bool> touched;
+
+    // 影子缓存中的行地址，最近访问的在前
+    std::list<uint32_t> lru;
+    std::unordered_map<uint32_t, std::list<uint32_t>::iterator> where;
+
+    StatCounter compulsory_count;
+    StatCounter capacity_count;
+    StatCounter conflict_count;
+    // 按 load 指令的地址
+    StatTable compulsory_by_PC;
+    StatTable capacity_by_PC;
+    StatTable conflict_by_PC;
+
+    // 访问影子缓存，返回访问前是否命中
+    bool shadowAccess(uint32_t line) {
+        auto it = where.find(line);
+        if (it != where.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            return true;
+        }
+        lru.push_front(line);
+        where[line] = lru.begin();
+        if (lru.size() > capacity) {
+            where.erase(lru.back());
+            lru.pop_back();
+        }
+        return false;
+    }
+
+   public:
+    MissClassifier(size_t capacity) : capacity(capacity) {}
+
+    // 地址为 PC 的 load 访问第 line 行（地址除以行大小），hit 为被观察的缓存
+    // 是否命中
+    Kind access(uint32_t line, bool hit, uint32_t PC) {
+        bool first = line >= touched.size() || !touched[line];
+        if (line >= touched.size()) {
+            touched.resize(size_t(line) + 1);
+        }
+        touched[line] = true;
+        bool shadow_hit = shadowAccess(line);
+
+        if (hit) {
+            return Hit;
+        }
+        if (first) {
+            ++compulsory_count;
+            compulsory_by_PC.add(PC);
+            return Compulsory;
+        }
+        if (!shadow_hit) {
+            ++capacity_count;
+            capacity_by_PC.add(PC);
+            return Capacity;
+        }
+        ++conflict_count;
+        conflict_by_PC.add(PC);
+        return Conflict;
+    }
+
+    size_t compulsoryCount() const { return compulsory_count; }
+    size_t capacityCount() const { return capacity_count; }
+    size_t conflictCount() const { return conflict_count; }
+
+    void registerStats(StatRegistry &registry,
+                       const std::string &prefix) const {
+        registry.add(prefix + ".compulsory", "misses on first touch of a line",
+                     compulsory_count);
+        registry.add(prefix + ".capacity",
+                     "misses a fully associative LRU cache also takes",
+                     capacity_count);
+        registry.add(prefix + ".conflict",
+                     "misses only the set mapping causes", conflict_count);
+        registry.add(prefix + ".compulsory_pc", "compulsory misses by load PC",
+                     compulsory_by_PC);
+        registry.add(prefix + ".capacity_pc", "capacity misses by load PC",
+                     capacity_by_PC);
+        registry.add(prefix + ".conflict_pc", "conflict misses by load PC",
+                     conflict_by_PC);
+    }
+
+    void reset() {
+        touched.clear();
+        lru.clear();
+        where.clear();
+        compulsory_count.reset();
+        capacity_count.reset();
+        conflict_count.reset();
+        compulsory_by_PC.reset();
+        capacity_by_PC.reset();
+        conflict_by_PC.reset();
+    }
+};
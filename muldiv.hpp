@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <stdexcept>
+#include <string>
+
+#include "bus.hpp"
+#include "stats.hpp"
+#include "utils.hpp"
+
+// RV32M 乘除法单元：Latency 级流水，分派后第 Latency 个周期起在 CDB 上广播，
+// 最后一级的结果要等 CDB 选中才离开，之前的各级在下一级空出时前移。
+// Pipelined 为 false 时同一时刻只容纳一条指令（迭代除法器）
+template <size_t Latency, bool Pipelined>
+    requires(Latency > 0)
+class MulDivUnit : public Updatable, public CDBSource {
+    // 第 k 级的指令与结果，reorder_index 为 0 表示空
+    size_t index_of[Latency];
+    uint32_t result_of[Latency];
+
+    // pull 时锁存，update 时推进流水线
+    ALUBus latched_bus;
+    bool latched_advance[Latency];
+    bool latched_clear;
+    SquashBus latched_squash;
+
+    StatCounter cycle_count;
+    StatCounter op_count;
+    StatCounter busy_count;
+    StatCounter stall_count;
+
+    static uint32_t compute(const ALUBus &bus) {
+        int32_t a = static_cast<int32_t>(bus.num_A);
+        int32_t b = static_cast<int32_t>(bus.num_B);
+        switch (bus.subop) {
+            case 0b000:  // mul
+                return bus.num_A * bus.num_B;
+            case 0b001:  // mulh
+                return uint64_t(int64_t(a) * int64_t(b)) >> 32;
+            case 0b010:  // mulhsu
+                return uint64_t(int64_t(a) * int64_t(bus.num_B)) >> 32;
+            case 0b011:  // mulhu
+                return (uint64_t(bus.num_A) * bus.num_B) >> 32;
+            case 0b100:  // div，除以 0 得 -1，溢出时得被除数
+                if (b == 0) return 0xFFFFFFFFU;
+                if (a == INT32_MIN && b == -1) return bus.num_A;
+                return static_cast<uint32_t>(a / b);
+            case 0b101:  // divu
+                return b == 0 ? 0xFFFFFFFFU : bus.num_A / bus.num_B;
+            case 0b110:  // rem，除以 0 得被除数，溢出时得 0
+                if (b == 0) return bus.num_A;
+                if (a == INT32_MIN && b == -1) return 0;
+                return static_cast<uint32_t>(a % b);
+            case 0b111:  // remu
+                return b == 0 ? bus.num_A : bus.num_A % bus.num_B;
+            default:
+                throw std::runtime_error(
+                    std::format("Unknown M extension operation code 0b{:03b}",
+                                uint8_t(bus.subop)));
+        }
+    }
+
+    bool dropped(size_t index) {
+        return index != 0 && (clear || squash.value().younger(index));
+    }
+
+    // 第 k 级本周期能否前移（最后一级为被 CDB 选中）
+    bool advances(size_t k) {
+        if (index_of[k] == 0 || dropped(index_of[k])) {
+            return false;
+        }
+        if (k + 1 == Latency) {
+            return cdb.value().reorder_index == index_of[k];
+        }
+        return index_of[k + 1] == 0 || dropped(index_of[k + 1]) ||
+               advances(k + 1);
+    }
+
+    size_t occupied() const {
+        size_t count = 0;
+        for (size_t k = 0; k < Latency; k++) {
+            count += index_of[k] != 0;
+        }
+        return count;
+    }
+
+    void init() {
+        for (size_t k = 0; k < Latency; k++) {
+            index_of[k] = 0;
+            result_of[k] = 0;
+            latched_advance[k] = false;
+        }
+        latched_bus = ALUBus();
+        latched_clear = false;
+        latched_squash = SquashBus();
+    }
+
+   public:
+    Wire<ALUBus> bus;
+    Wire<CommonDataBus> cdb;
+    Wire<bool> clear;
+    Wire<SquashBus> squash;
+
+    MulDivUnit() { init(); }
+
+    CommonDataBus CDBOut() const {
+        return CommonDataBus{index_of[Latency - 1], result_of[Latency - 1],
+                             0};
+    }
+
+    // 本周期不能接收新的指令
+    bool is_busy() {
+        if (Pipelined) {
+            return index_of[0] != 0 && !advances(0);
+        }
+        return occupied() != 0;
+    }
+
+    // 统计项名以 prefix 开头
+    void registerStats(StatRegistry &registry,
+                       const std::string &prefix) const {
+        registry.add(prefix + ".ops", "operations dispatched to the unit",
+                     op_count);
+        registry.add(prefix + ".busy", "cycles with an operation in flight",
+                     busy_count);
+        registry.add(prefix + ".stall",
+                     "cycles a finished result waited for the CDB",
+                     stall_count);
+        // 流水单元按每周期接收的指令数，迭代单元按占用的周期数
+        registry.add(prefix + ".utilization",
+                     "fraction of cycles the unit's issue slot was used",
+                     [&]() {
+                         return StatRegistry::ratio(
+                             Pipelined ? op_count : busy_count, cycle_count);
+                     });
+    }
+
+    void pull() {
+        latched_clear = clear;
+        latched_squash = squash;
+        latched_bus = bus;
+        for (size_t k = 0; k < Latency; k++) {
+            latched_advance[k] = advances(k);
+        }
+
+        if (stats_enabled) {
+            ++cycle_count;
+            op_count += latched_bus.reorder_index != 0;
+            busy_count += occupied() != 0;
+            stall_count += index_of[Latency - 1] != 0 &&
+                           !latched_advance[Latency - 1];
+        }
+    }
+
+    void update() {
+        for (size_t k = Latency; k-- > 0;) {
+            if (latched_clear || latched_squash.younger(index_of[k])) {
+                index_of[k] = 0;
+                continue;
+            }
+            if (!latched_advance[k]) continue;
+            if (k + 1 < Latency) {
+                index_of[k + 1] = index_of[k];
+                result_of[k + 1] = result_of[k];
+            }
+            index_of[k] = 0;
+        }
+
+        if (!latched_clear && latched_bus.reorder_index != 0) {
+            if (index_of[0] != 0) {
+                throw std::runtime_error("The requested M unit is busy!");
+            }
+            index_of[0] = latched_bus.reorder_index;
+            result_of[0] = compute(latched_bus);
+        }
+    }
+
+    void reset() {
+        init();
+        cycle_count.reset();
+        op_count.reset();
+        busy_count.reset();
+        stall_count.reset();
+    }
+};
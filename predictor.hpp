@@ -1,70 +1,138 @@
 #pragma once
 
-#include <bitset>
 #include <concepts>
 #include <cstddef>
 #include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
 
 #include "bus.hpp"
+#include "stats.hpp"
 #include "utils.hpp"
 
+// 预测用推测的历史：取指用掉预测时就把预测方向移入历史，后端转向时恢复为
+// 已提交分支的历史，再按程序顺序重放保留下来的已发射分支。取指队列中尚未
+// 发射的分支随转向一起作废，不必重放
 class Predictor : public Updatable {
-    Reg<size_t> total_branch;
-    Reg<size_t> correct_branch;
-    Reg<size_t> total_jalr;
-    Reg<size_t> correct_jalr;
+    StatCounter total_branch;
+    StatCounter correct_branch;
+    StatCounter total_jalr;
+    StatCounter correct_jalr;
+
+    // 已发射而未提交的条件分支，从老到新
+    std::deque<BranchHistoryBus> inflight;
+
+    BranchHistoryBus latched_fetched{};
+    BranchHistoryBus latched_issued{};
+    SquashBus latched_squash{};
+    bool latched_clear = false;
+    bool latched_commit = false;
+
+   protected:
+    // 把 PC 处分支的方向 taken 移入推测的历史
+    virtual void speculate(uint32_t, bool) {}
+    // 推测的历史恢复为已提交分支的历史
+    virtual void restoreHistory() {}
 
    public:
     Wire<uint32_t> PC;
     Wire<PredictFeedbackBus> feedback;
-
-    Predictor() {
-        total_branch <= [&]() -> size_t {
-            PredictFeedbackBus fb = feedback;
-            return total_branch + (fb.type == PredictFeedbackBus::Branch);
-        };
-
-        correct_branch <= [&]() -> size_t {
-            PredictFeedbackBus fb = feedback;
-            return correct_branch + (fb.type == PredictFeedbackBus::Branch &&
-                                     !fb.is_mispredicted);
-        };
-
-        total_jalr <= [&]() -> size_t {
-            PredictFeedbackBus fb = feedback;
-            return total_jalr + (fb.type == PredictFeedbackBus::Jalr);
-        };
-
-        correct_jalr <= [&]() -> size_t {
-            PredictFeedbackBus fb = feedback;
-            return correct_jalr +
-                   (fb.type == PredictFeedbackBus::Jalr && !fb.is_mispredicted);
-        };
-    }
+    Wire<BranchHistoryBus> fetched;  // 取指用掉了预测的条件分支
+    Wire<BranchHistoryBus> issued;   // 发射进 ROB 的条件分支
+    Wire<SquashBus> squash;
+    Wire<bool> clear;
 
     PredictorStatistics predictorStatistics() const {
         return PredictorStatistics{total_branch, correct_branch, total_jalr,
                                    correct_jalr};
     }
 
+    void registerStats(StatRegistry &registry,
+                       const std::string &prefix) const {
+        registry.add(prefix + ".branch.total", "committed branches",
+                     total_branch);
+        registry.add(prefix + ".branch.correct", "correctly predicted branches",
+                     correct_branch);
+        registry.add(prefix + ".branch.accuracy", "branch prediction accuracy",
+                     [&]() {
+                         return StatRegistry::ratio(correct_branch,
+                                                    total_branch);
+                     });
+        registry.add(prefix + ".jalr.total", "committed jalr", total_jalr);
+        registry.add(prefix + ".jalr.correct", "correctly predicted jalr",
+                     correct_jalr);
+        registry.add(prefix + ".jalr.accuracy", "jalr prediction accuracy",
+                     [&]() {
+                         return StatRegistry::ratio(correct_jalr, total_jalr);
+                     });
+    }
+
     virtual bool branch()  = 0;
 
     virtual void pull() {
-#ifdef PROFILE
-        total_branch.pull();
-        correct_branch.pull();
-        total_jalr.pull();
-        correct_jalr.pull();
-#endif
+        PredictFeedbackBus fb = feedback;
+        if (stats_enabled) {
+            if (fb.type == PredictFeedbackBus::Branch) {
+                ++total_branch;
+                correct_branch += !fb.is_mispredicted;
+            } else if (fb.type == PredictFeedbackBus::Jalr) {
+                ++total_jalr;
+                correct_jalr += !fb.is_mispredicted;
+            }
+        }
+
+        latched_fetched = fetched;
+        latched_issued = issued;
+        latched_squash = squash;
+        latched_clear = clear;
+        latched_commit = fb.type == PredictFeedbackBus::Branch;
     }
 
+    // 子类先写入已提交的历史，再调用这里更新推测的历史
     virtual void update() {
-#ifdef PROFILE
-        total_branch.update();
-        correct_branch.update();
-        total_jalr.update();
-        correct_jalr.update();
-#endif
+        if (latched_commit && !inflight.empty()) {
+            inflight.pop_front();
+        }
+
+        bool recover = latched_clear || latched_squash.flag;
+        if (latched_clear) {
+            inflight.clear();
+        } else if (latched_squash.flag) {
+            while (!inflight.empty() &&
+                   latched_squash.younger(inflight.back().reorder_index)) {
+                inflight.pop_back();
+            }
+            // 预测失败的分支按实际方向重放
+            if (!latched_squash.replay && !inflight.empty() &&
+                inflight.back().reorder_index == latched_squash.branch) {
+                inflight.back().branched = !inflight.back().branched;
+            }
+        } else if (latched_issued.flag) {
+            inflight.push_back(latched_issued);
+        }
+
+        if (recover) {
+            restoreHistory();
+            for (const BranchHistoryBus &b : inflight) {
+                speculate(b.PC, b.branched);
+            }
+        }
+        // 转向的同一周期已从新地址取指
+        if (latched_fetched.flag) {
+            speculate(latched_fetched.PC, latched_fetched.branched);
+        }
+    }
+
+    virtual void reset() {
+        total_branch.reset();
+        correct_branch.reset();
+        total_jalr.reset();
+        correct_jalr.reset();
+        inflight.clear();
+        latched_fetched = latched_issued = BranchHistoryBus();
+        latched_squash = SquashBus();
+        latched_clear = latched_commit = false;
     }
 };
 
@@ -80,136 +148,188 @@ class NeverBranchPredictor : public Predictor {
 
 enum BinaryPredictState { StronglyB, WeaklyB, WeaklyNo, StronglyNo };
 
+// 2 位饱和计数器向 toward_branch 的方向走一步
+inline BinaryPredictState trainState(BinaryPredictState state,
+                                     bool toward_branch) {
+    switch (state) {
+        case StronglyB:
+            return toward_branch ? StronglyB : WeaklyB;
+        case WeaklyB:
+            return toward_branch ? StronglyB : WeaklyNo;
+        case WeaklyNo:
+            return toward_branch ? WeaklyB : StronglyNo;
+        default:  // StronglyNo
+            return toward_branch ? WeaklyNo : StronglyNo;
+    }
+}
+
+inline bool predictsBranch(BinaryPredictState state) {
+    return state == StronglyB || state == WeaklyB;
+}
+
+// 按每项 Width 位打包的表。每周期至多更新一项：pull 时暂存到 pending，
+// update 时才写入，同一周期内读到的仍是旧值
+template <size_t Width>
+    requires(Width > 0 && Width <= 32 && 64 % Width == 0)
+class PackedTable {
+    constexpr static size_t PerWord = 64 / Width;
+    constexpr static uint64_t Mask = (uint64_t(1) << Width) - 1;
+
+    std::vector<uint64_t> words;
+    uint32_t init_value;
+
+    bool pending_valid;
+    size_t pending_index;
+    uint32_t pending_value;
+
+   public:
+    PackedTable(size_t size, uint32_t init_value = 0)
+        : words((size + PerWord - 1) / PerWord), init_value(init_value) {
+        reset();
+    }
+
+    uint32_t get(size_t index) const {
+        return (words[index / PerWord] >> (index % PerWord * Width)) & Mask;
+    }
+
+    // 暂存本周期的更新，覆盖之前暂存而尚未写入的更新
+    void stage(size_t index, uint32_t value) {
+        pending_valid = true;
+        pending_index = index;
+        pending_value = value;
+    }
+
+    void update() {
+        if (!pending_valid) {
+            return;
+        }
+        uint64_t &word = words[pending_index / PerWord];
+        size_t shift = pending_index % PerWord * Width;
+        word = (word & ~(Mask << shift)) | (uint64_t(pending_value) << shift);
+        pending_valid = false;
+    }
+
+    void reset() {
+        uint64_t word = 0;
+        for (size_t i = 0; i < PerWord; i++) {
+            word |= uint64_t(init_value & Mask) << (i * Width);
+        }
+        words.assign(words.size(), word);
+        pending_valid = false;
+    }
+};
+
 template <size_t Bits, BinaryPredictState InitState>
     requires(Bits <= 32)
 class BinaryPredictor : public Predictor {
-    Reg<BinaryPredictState> states[1U << Bits];
+    PackedTable<2> states;
 
    public:
-    BinaryPredictor() : Predictor() {
-        for (size_t i = 0; i < (1U << Bits); i++) {
-            states[i] = InitState;
-
-            states[i] <= [&, i]() -> BinaryPredictState {
-                PredictFeedbackBus fb = feedback;
-
-                if (fb.type != PredictFeedbackBus::Branch ||
-                    (fb.PC & ((1U << Bits) - 1)) != i) {
-                    return states[i];
-                }
-
-                bool should_branch = fb.predict_branch ^ fb.is_mispredicted;
-
-                switch (states[i]) {
-                    case StronglyB:
-                        return should_branch ? StronglyB : WeaklyB;
-                    case WeaklyB:
-                        return should_branch ? StronglyB : WeaklyNo;
-                    case WeaklyNo:
-                        return should_branch ? WeaklyB : StronglyNo;
-                    default:  // StronglyNo
-                        return should_branch ? WeaklyNo : StronglyNo;
-                }
-            };
-        }
-    }
+    BinaryPredictor() : Predictor(), states(1U << Bits, InitState) {}
 
-    bool branch()  {
-        BinaryPredictState state = states[PC & ((1U << Bits) - 1)];
-        return state == StronglyB || state == WeaklyB;
+    bool branch() {
+        return predictsBranch(
+            BinaryPredictState(states.get(PC & ((1U << Bits) - 1))));
     }
 
     void pull() {
         Predictor::pull();
-        for (auto &state : states) {
-            state.pull();
+
+        PredictFeedbackBus fb = feedback;
+        if (fb.type != PredictFeedbackBus::Branch) {
+            return;
         }
+
+        size_t index = fb.PC & ((1U << Bits) - 1);
+        bool should_branch = fb.predict_branch ^ fb.is_mispredicted;
+        states.stage(index, trainState(BinaryPredictState(states.get(index)),
+                                       should_branch));
     }
 
     void update() {
         Predictor::update();
-        for (auto &state : states) {
-            state.update();
-        }
+        states.update();
+    }
+
+    void reset() {
+        Predictor::reset();
+        states.reset();
     }
 };
 
 // (M, 2) 分支预测器
 template <size_t Bits, size_t M>
-    requires(Bits <= 32 && M > 0)
+    requires(Bits <= 32 && M > 0 && M < 32)
 class CorrelatingPredictor : public Predictor {
-    Reg<std::bitset<M>> histories[1U << Bits];
-    Reg<BinaryPredictState> states[1U << M];
+    typedef PackedTable<M <= 2    ? 2
+                        : M <= 4  ? 4
+                        : M <= 8  ? 8
+                        : M <= 16 ? 16
+                                  : 32>
+        HistoryTable;
+
+    HistoryTable histories;       // 已提交分支的历史，训练时用
+    HistoryTable spec_histories;  // 推测的历史，预测时用
+    PackedTable<2> states;
+
+    size_t historyIndex(uint32_t PC) const {
+        return histories.get(PC & ((1U << Bits) - 1));
+    }
 
-   public:
-    CorrelatingPredictor() : Predictor() {
-        for (size_t i = 0; i < (1U << Bits); i++) {
-            histories[i] <= [&, i]() -> std::bitset<M> {
-                PredictFeedbackBus fb = feedback;
-
-                if (fb.type != PredictFeedbackBus::Branch ||
-                    (fb.PC & ((1U << Bits) - 1)) != i) {
-                    return histories[i];
-                }
-
-                auto ret = std::bitset<M>(histories[i]) << 1;
-                ret[0] = fb.predict_branch ^ fb.is_mispredicted;
-                return ret;
-            };
-        }
+    uint32_t shiftHistory(size_t history, bool taken) const {
+        return ((history << 1) | taken) & ((uint64_t(1) << M) - 1);
+    }
 
-        for (size_t i = 0; i < (1U << M); i++) {
-            states[i] <= [&, i]() -> BinaryPredictState {
-                PredictFeedbackBus fb = feedback;
-                size_t state_index =
-                    std::bitset<M>(histories[fb.PC & ((1U << Bits) - 1)])
-                        .to_ulong();
-
-                if (fb.type != PredictFeedbackBus::Branch || state_index != i) {
-                    return states[i];
-                }
-
-                bool should_branch = fb.predict_branch ^ fb.is_mispredicted;
-
-                switch (states[i]) {
-                    case StronglyB:
-                        return should_branch ? StronglyB : WeaklyB;
-                    case WeaklyB:
-                        return should_branch ? StronglyB : WeaklyNo;
-                    case WeaklyNo:
-                        return should_branch ? WeaklyB : StronglyNo;
-                    default:  // StronglyNo
-                        return should_branch ? WeaklyNo : StronglyNo;
-                }
-            };
-        }
+   protected:
+    void speculate(uint32_t PC, bool taken) {
+        size_t index = PC & ((1U << Bits) - 1);
+        spec_histories.stage(index,
+                             shiftHistory(spec_histories.get(index), taken));
+        spec_histories.update();
     }
 
-    bool branch()  {
-        BinaryPredictState state =
-            states[std::bitset<M>(histories[PC & ((1U << Bits) - 1)])
-                       .to_ulong()];
-        return state == StronglyB || state == WeaklyB;
+    void restoreHistory() { spec_histories = histories; }
+
+   public:
+    CorrelatingPredictor()
+        : Predictor(),
+          histories(1U << Bits),
+          spec_histories(1U << Bits),
+          states(1U << M) {}
+
+    bool branch() {
+        size_t history = spec_histories.get(PC & ((1U << Bits) - 1));
+        return predictsBranch(BinaryPredictState(states.get(history)));
     }
 
     void pull() {
         Predictor::pull();
-        for (auto &history : histories) {
-            history.pull();
-        }
-        for (auto &state : states) {
-            state.pull();
+
+        PredictFeedbackBus fb = feedback;
+        if (fb.type != PredictFeedbackBus::Branch) {
+            return;
         }
+
+        bool should_branch = fb.predict_branch ^ fb.is_mispredicted;
+        size_t state_index = historyIndex(fb.PC);
+        states.stage(state_index,
+                     trainState(BinaryPredictState(states.get(state_index)),
+                                should_branch));
+        histories.stage(fb.PC & ((1U << Bits) - 1),
+                        shiftHistory(state_index, should_branch));
     }
 
     void update() {
+        histories.update();
+        states.update();
         Predictor::update();
-        for (auto &history : histories) {
-            history.update();
-        }
-        for (auto &state : states) {
-            state.update();
-        }
+    }
+
+    void reset() {
+        Predictor::reset();
+        histories.reset();
+        spec_histories.reset();
+        states.reset();
     }
 };
 
@@ -219,58 +339,60 @@ template <size_t Bits, typename Predictor1, typename Predictor2>
 class TournamentPredictor : public Predictor {
     Predictor1 predictor1;
     Predictor2 predictor2;
-    Reg<BinaryPredictState> states[1U << Bits];
+    // 偏向 B 时选用 predictor1
+    PackedTable<2> states;
 
    public:
-    TournamentPredictor() : Predictor() {
+    TournamentPredictor() : Predictor(), states(1U << Bits, StronglyB) {
         predictor1.PC = LAM(PC);
         predictor2.PC = LAM(PC);
         predictor1.feedback = LAM(feedback);
         predictor2.feedback = LAM(feedback);
-
-        for (size_t i = 0; i < (1U << Bits); i++) {
-            states[i] <= [&, i]() -> BinaryPredictState {
-                PredictFeedbackBus fb = feedback;
-                if (fb.type != PredictFeedbackBus::Branch ||
-                    (fb.PC & ((1U << Bits) - 1)) != i) {
-                    return states[i];
-                }
-
-                switch (states[i]) {
-                    case StronglyB:
-                        return fb.is_mispredicted ? WeaklyB : StronglyB;
-                    case WeaklyB:
-                        return fb.is_mispredicted ? WeaklyNo : StronglyB;
-                    case WeaklyNo:
-                        return fb.is_mispredicted ? WeaklyB : StronglyNo;
-                    default:  // StronglyNo
-                        return fb.is_mispredicted ? WeaklyNo : StronglyNo;
-                }
-            };
-        }
+        // 两个预测器都按最终选用的方向推测地更新历史
+        predictor1.fetched = LAM(fetched);
+        predictor2.fetched = LAM(fetched);
+        predictor1.issued = LAM(issued);
+        predictor2.issued = LAM(issued);
+        predictor1.squash = LAM(squash);
+        predictor2.squash = LAM(squash);
+        predictor1.clear = LAM(clear);
+        predictor2.clear = LAM(clear);
     }
 
-    bool branch()  {
-        BinaryPredictState bps = states[PC & ((1U << Bits) - 1)];
-        return bps == StronglyB || bps == WeaklyB ? predictor1.branch()
-                                                  : predictor2.branch();
+    bool branch() {
+        BinaryPredictState bps =
+            BinaryPredictState(states.get(PC & ((1U << Bits) - 1)));
+        return predictsBranch(bps) ? predictor1.branch() : predictor2.branch();
     }
 
     void pull() {
         Predictor::pull();
-        for (auto &state : states) {
-            state.pull();
+
+        PredictFeedbackBus fb = feedback;
+        if (fb.type == PredictFeedbackBus::Branch) {
+            size_t index = fb.PC & ((1U << Bits) - 1);
+            BinaryPredictState bps = BinaryPredictState(states.get(index));
+            // 预测失败时向另一侧移动，否则加强当前的选择
+            states.stage(index,
+                         trainState(bps, predictsBranch(bps) ^
+                                             fb.is_mispredicted));
         }
+
         predictor1.pull();
         predictor2.pull();
     }
 
     void update() {
         Predictor::update();
-        for (auto &state : states) {
-            state.update();
-        }
+        states.update();
         predictor1.update();
         predictor2.update();
     }
-};
\ No newline at end of file
+
+    void reset() {
+        Predictor::reset();
+        states.reset();
+        predictor1.reset();
+        predictor2.reset();
+    }
+};
@@ -1,69 +1,205 @@
 #pragma once
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
+#include <stdexcept>
+#include <vector>
 
 #include "bus.hpp"
 #include "utils.hpp"
 
+// 合并的物理寄存器堆：体系结构寄存器经重命名表映射到 physical_count 个物理
+// 寄存器之一，0 号物理寄存器固定为 x0，空闲的物理寄存器放在环形的空闲表中。
+// length 为 ROB 长度，每个 ROB 表项有一份重命名表的检查点
+template <size_t length>
 class Regs : public Updatable {
-    Reg<uint32_t> _regs[32];
-    Reg<size_t> _reorder[32];
+    struct Checkpoint {
+        std::array<size_t, 32> map;
+        size_t pops;
+    };
+
+    const size_t physical_count;
+
+    Reg<size_t> rename_map[32];  // 推测的重命名表
+    Reg<size_t> retire_map[32];  // 已提交的重命名表
+    // 从空闲表取出、放回的累计次数，二者之差即空闲的物理寄存器数
+    Reg<size_t> pops;
+    Reg<size_t> pushes;
+
+    std::vector<uint32_t> values;
+    std::vector<bool> ready;
+    std::vector<size_t> free_list;  // 长度为 physical_count - 32
+
+    // 分支发射时保存的重命名表，下标为分支的 ROB 下标
+    Checkpoint checkpoints[length + 1];
+
+    // pull 时锁存，update 时写入物理寄存器堆与空闲表
+    RegIssueBus latched_issue;
+    RegCommitBus latched_commit;
+    CommonDataBus latched_cdb;
+    size_t checkpoint_index;
+
+    size_t freeListLength() const { return physical_count - 32; }
+
+    void init() {
+        for (size_t i = 0; i < 32; i++) {
+            rename_map[i].reset(i);
+            retire_map[i].reset(i);
+        }
+        pops.reset(0);
+        pushes.reset(freeListLength());
+
+        values.assign(physical_count, 0);
+        ready.assign(physical_count, true);
+        for (size_t i = 0; i < freeListLength(); i++) {
+            free_list[i] = 32 + i;
+        }
+
+        latched_issue = RegIssueBus();
+        latched_commit = RegCommitBus();
+        latched_cdb = CommonDataBus();
+        checkpoint_index = 0;
+    }
 
    public:
     Wire<RegIssueBus> issue_bus;
     Wire<RegCommitBus> commit_bus;
+    Wire<CommonDataBus> cdb;
     Wire<bool> clear;
+    // 本周期发射的指令的恢复点：恢复时保留到的 ROB 下标，0 表示没有
+    Wire<size_t> checkpoint;
+    Wire<SquashBus> squash;
+
+    Regs(size_t physical_count)
+        : physical_count(physical_count),
+          free_list(physical_count > 32 ? physical_count - 32 : 0) {
+        if (physical_count <= 32) {
+            throw std::runtime_error(
+                "The physical register file needs more than 32 registers!");
+        }
+        init();
 
-    Regs() {
-        _regs[0] <= LAM(0);
-        _reorder[0] <= LAM(0);
+        rename_map[0] <= LAM(0);
+        retire_map[0] <= LAM(0);
 
         for (uint8_t i = 1; i < 32; i++) {
-            _regs[i] <= [&, i]() -> uint32_t {
-                RegCommitBus cb = commit_bus;
-                if (cb.rd == i) {
-                    return cb.data;
+            rename_map[i] <= [&, i]() -> size_t {
+                // 清空时回到提交后的状态，引起清空的 jalr 本身也提交
+                if (clear) {
+                    RegCommitBus cb = commit_bus;
+                    return cb.rd == i ? cb.preg : retire_map[i];
                 }
 
-                return _regs[i];
-            };
-            _reorder[i] <= [&, i]() -> size_t {
-                if (clear) return 0;
+                SquashBus sb = squash;
+                if (sb.flag) {
+                    return checkpoints[sb.branch].map[i];
+                }
 
                 RegIssueBus ib = issue_bus;
-                if (i == ib.rd) {
-                    return ib.reorder_index;
+                if (ib.rd == i) {
+                    return ib.preg;
                 }
 
+                return rename_map[i];
+            };
+            retire_map[i] <= [&, i]() -> size_t {
                 RegCommitBus cb = commit_bus;
-                if (cb.reorder_index != 0 && _reorder[i] == cb.reorder_index) {
-                    return 0;
+                if (cb.rd == i) {
+                    return cb.preg;
                 }
 
-                return _reorder[i];
+                return retire_map[i];
             };
         }
+
+        pops <= [&]() -> size_t {
+            // 流水线清空时所有推测分配的物理寄存器回到空闲表
+            if (clear) {
+                return pushes + (commit_bus.value().rd != 0) -
+                       freeListLength();
+            }
+
+            SquashBus sb = squash;
+            if (sb.flag) {
+                return checkpoints[sb.branch].pops;
+            }
+
+            return pops + (issue_bus.value().preg != 0);
+        };
+        pushes <= [&]() -> size_t {
+            return pushes + (commit_bus.value().rd != 0);
+        };
     }
 
+    // 下一个可分配的物理寄存器，0 表示空闲表已空
+    size_t freeReg() const {
+        return pushes == pops ? 0 : free_list[pops % freeListLength()];
+    }
+
+    size_t freeCount() const { return pushes - pops; }
+
+    size_t rename(uint8_t index) const { return rename_map[index]; }
+
+    bool isReady(size_t preg) const { return ready[preg]; }
+
+    uint32_t value(size_t preg) const { return values[preg]; }
+
+    // 已提交的体系结构状态
+    uint32_t reg(uint8_t index) const { return values[retire_map[index]]; }
+
     void pull() {
-        for (auto &reg : _regs) {
+        latched_issue = clear ? RegIssueBus() : issue_bus;
+        latched_commit = commit_bus;
+        latched_cdb = cdb;
+        checkpoint_index = checkpoint;
+
+        for (auto &reg : rename_map) {
             reg.pull();
         }
-        for (auto &recorder : _reorder) {
-            recorder.pull();
+        for (auto &reg : retire_map) {
+            reg.pull();
         }
+        pops.pull();
+        pushes.pull();
     }
+
     void update() {
-        for (auto &reg : _regs) {
+        if (checkpoint_index != 0) {
+            // 恢复点是本周期发射的指令本身时（融合的比较与分支会写 rd），
+            // 保存的状态要包括它的重命名
+            bool own = latched_issue.reorder_index == checkpoint_index &&
+                       latched_issue.preg != 0;
+            Checkpoint &saved = checkpoints[checkpoint_index];
+            for (size_t i = 0; i < 32; i++) {
+                saved.map[i] = own && latched_issue.rd == i
+                                   ? latched_issue.preg
+                                   : size_t(rename_map[i]);
+            }
+            saved.pops = pops + own;
+        }
+
+        if (latched_commit.rd != 0) {
+            free_list[pushes % freeListLength()] = latched_commit.prev;
+        }
+        if (latched_issue.preg != 0) {
+            ready[latched_issue.preg] = latched_issue.ready;
+            values[latched_issue.preg] = latched_issue.value;
+        }
+        if (latched_cdb.preg != 0) {
+            ready[latched_cdb.preg] = true;
+            values[latched_cdb.preg] = latched_cdb.data;
+        }
+
+        for (auto &reg : rename_map) {
             reg.update();
         }
-        for (auto &recorder : _reorder) {
-            recorder.update();
+        for (auto &reg : retire_map) {
+            reg.update();
         }
+        pops.update();
+        pushes.update();
     }
 
-    uint32_t reg(uint8_t index) const { return _regs[index]; }
-
-    size_t reorder(uint8_t index) const { return _reorder[index]; }
-};
\ No newline at end of file
+    void reset() { init(); }
+};
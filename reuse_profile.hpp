@@ -0,0 +1,105 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "stack_distance.hpp"
+#include "stats.hpp"
+
+// 按缓存行剖析提交的 load/store 的局部性，与具体的缓存配置无关：
+// 重用距离为两次访问同一行之间访问过的不同行数，按 2 的幂分桶；
+// 工作集为每 window 次访问中访问到的不同行数，只统计完整的窗口。
+// 重用距离不小于 far_distance 行或首次访问的，按访存指令的地址另行计数
+class ReuseProfiler {
+    size_t line_bits;
+    size_t window;
+    size_t far_distance;
+
+    StackDistance stack;
+    // 每行最近一次被访问的窗口编号加 1
+    std::unordered_map<uint64_t, size_t> last_window;
+    size_t window_index;
+    size_t window_accesses;
+    size_t window_lines;
+
+    StatCounter cold_count;
+    StatHistogram distance;
+    StatHistogram working_set;
+    StatTable working_set_by_window;
+    // 按 load/store 指令的地址
+    StatTable access_by_PC;
+    StatTable far_by_PC;
+    StatTable cold_by_PC;
+
+   public:
+    // line_size 为 2 的幂
+    ReuseProfiler(size_t line_size, size_t window, size_t far_distance)
+        : line_bits(std::countr_zero(line_size)),
+          window(window),
+          far_distance(far_distance),
+          distance(25, 1, StatHistogram::Log2),
+          working_set(std::bit_width(window) + 1, 1, StatHistogram::Log2) {
+        reset();
+    }
+
+    // 地址为 PC 的 load/store 访问 address
+    void access(uint32_t address, uint32_t PC) {
+        uint64_t line = address >> line_bits;
+        size_t d = stack.access(line);
+        access_by_PC.add(PC);
+        if (d == infiniteDistance) {
+            ++cold_count;
+            cold_by_PC.add(PC);
+        } else {
+            distance.sample(d);
+            if (d >= far_distance) far_by_PC.add(PC);
+        }
+
+        size_t &seen = last_window[line];
+        if (seen != window_index + 1) {
+            seen = window_index + 1;
+            window_lines++;
+        }
+        if (++window_accesses == window) {
+            working_set.sample(window_lines);
+            working_set_by_window.add(window_index, window_lines);
+            window_index++;
+            window_accesses = window_lines = 0;
+        }
+    }
+
+    void registerStats(StatRegistry &registry,
+                       const std::string &prefix) const {
+        registry.add(prefix + ".cold", "first touches of a line", cold_count);
+        registry.add(prefix + ".distance",
+                     "distinct lines touched between reuses of a line",
+                     distance);
+        registry.add(prefix + ".working_set",
+                     "distinct lines touched per access window", working_set);
+        registry.add(prefix + ".working_set_window",
+                     "distinct lines touched by window index",
+                     working_set_by_window);
+        registry.add(prefix + ".access_pc", "accesses by load/store PC",
+                     access_by_PC);
+        registry.add(prefix + ".far_pc", "far reuses by load/store PC",
+                     far_by_PC);
+        registry.add(prefix + ".cold_pc", "first touches by load/store PC",
+                     cold_by_PC);
+    }
+
+    void reset() {
+        stack.reset();
+        last_window.clear();
+        window_index = window_accesses = window_lines = 0;
+        cold_count.reset();
+        distance.reset();
+        working_set.reset();
+        working_set_by_window.reset();
+        access_by_PC.reset();
+        far_by_PC.reset();
+        cold_by_PC.reset();
+    }
+};
@@ -1,27 +1,32 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <format>
+#include <functional>
 #include <stdexcept>
-#include <type_traits>
+#include <string>
 
 #include "ROB.hpp"
 #include "bus.hpp"
+#include "stats.hpp"
 #include "utils.hpp"
 
-template <typename SpecBus>
 class ReservationStation : public Updatable {
     Reg<RSBus> ins;
 
-    bool is_ready() const { return RSBus(ins).qj == 0 && RSBus(ins).qk == 0; }
-
    public:
     Wire<CommonDataBus> cdb;
     Wire<RSBus> new_instruction;
     Wire<bool> clear;
+    Wire<bool> dispatched;  // 本周期被分派给功能单元，表项随即释放
+    Wire<SquashBus> squash;
 
     ReservationStation() {
         ins <= [&]() -> RSBus {
-            if (clear) {
+            if (clear || dispatched ||
+                squash.value().younger(RSBus(ins).reorder_index)) {
                 return RSBus();
             }
 
@@ -37,48 +42,200 @@ class ReservationStation : public Updatable {
 
             CommonDataBus local_cdb = cdb;
 
-            if (local_cdb.reorder_index != 0 && local_cdb.reorder_index == old_ins.qj) {
+            // qj qk 为等待的物理寄存器
+            if (local_cdb.preg != 0 && local_cdb.preg == old_ins.qj) {
                 old_ins.vj = local_cdb.data;
                 old_ins.qj = 0;
             }
 
-            if (local_cdb.reorder_index != 0 && local_cdb.reorder_index == old_ins.qk) {
+            if (local_cdb.preg != 0 && local_cdb.preg == old_ins.qk) {
                 old_ins.vk = local_cdb.data;
                 old_ins.qk = 0;
             }
 
-            if (local_cdb.reorder_index != 0 && local_cdb.reorder_index == old_ins.reorder_index) {
-                old_ins.reorder_index = 0;
-            }
-
             return old_ins;
         };
     }
 
     bool is_busy() const { return RSBus(ins).reorder_index != 0; }
 
-    template<size_t ROBLength>
-    SpecBus execute(const ReorderBuffer<ROBLength>& rob) {
-        if (!clear && is_busy() && is_ready()) {
-            RSBus rsbus = ins;
-
-            if constexpr (std::is_same<SpecBus, ALUBus>()) {
-                return ALUBus{rsbus.reorder_index, rsbus.subop,
-                              rsbus.variant_flag, rsbus.vj, rsbus.vk};
-            } else if constexpr (std::is_same<SpecBus, MemBus>()) {
-                uint32_t address = rsbus.vj + rsbus.imm;
-                if (rob.canLoad(rsbus.reorder_index, address)) {
-                    return MemBus{rsbus.reorder_index, rsbus.subop, address,
-                                  rsbus.vk};
+    bool is_ready() const { return RSBus(ins).qj == 0 && RSBus(ins).qk == 0; }
+
+    const RSBus &instruction() const { return ins; }
+
+    void pull() { ins.pull(); }
+
+    void update() { ins.update(); }
+
+    void reset() { ins.reset(); }
+};
+
+// 统一发射队列：N 个表项由各类指令共享，每个端口连着一个功能单元并接受一种或
+// 几种 ExecuteType。每周期把就绪的指令按年龄（在 ROB 中距队头的距离）从老到新
+// 分派给能接受它的空闲端口
+template <size_t N, size_t Ports, size_t ROBLength>
+    requires(N > 0 && Ports > 0)
+class IssueQueue : public Updatable {
+    ReservationStation entries[N + 1];
+
+    const ReorderBuffer<ROBLength> &rob;
+
+    StatHistogram occupancy;
+    StatCounter dispatch_count[Ports + 1];
+
+    // 端口 -> 表项下标，0 表示该端口本周期不分派
+    Wire<std::array<size_t, Ports + 1>> selection;
+
+    bool can_dispatch(size_t index) {
+        const ReservationStation &entry = entries[index];
+        if (clear || !entry.is_busy() || !entry.is_ready()) {
+            return false;
+        }
+
+        const RSBus &rsbus = entry.instruction();
+        if (squash.value().younger(rsbus.reorder_index)) {
+            return false;
+        }
+
+        if (rsbus.type == Mem_T) {
+            return load_ready ? load_ready(rsbus)
+                              : rob.canLoad(rsbus.reorder_index,
+                                            rsbus.vj + rsbus.imm);
+        }
+        return true;
+    }
+
+    std::array<size_t, Ports + 1> select() {
+        std::array<size_t, Ports + 1> result{};
+
+        // 就绪表项按年龄插入排序
+        size_t candidates[N];
+        size_t candidate_count = 0;
+        for (size_t i = 1; i <= N; i++) {
+            if (!can_dispatch(i)) continue;
+
+            size_t age = rob.age(entries[i].instruction().reorder_index);
+            size_t j = candidate_count++;
+            while (j > 0 &&
+                   rob.age(entries[candidates[j - 1]].instruction()
+                               .reorder_index) > age) {
+                candidates[j] = candidates[j - 1];
+                j--;
+            }
+            candidates[j] = i;
+        }
+
+        for (size_t c = 0; c < candidate_count; c++) {
+            ExecuteType type = entries[candidates[c]].instruction().type;
+            for (size_t port = 1; port <= Ports; port++) {
+                if (result[port] == 0 &&
+                    (port_types[port] & typeBit(type)) && port_ready[port]) {
+                    result[port] = candidates[c];
+                    break;
                 }
-            } else {
-                static_assert(false, "Not supported type!");
             }
         }
-        return SpecBus();
+
+        return result;
     }
 
-    void pull() { ins.pull(); }
+   public:
+    Wire<CommonDataBus> cdb;
+    Wire<RSBus> new_instruction;
+    Wire<size_t> new_index;
+    Wire<bool> clear;
+    Wire<SquashBus> squash;
+
+    unsigned port_types[Ports + 1];  // 端口接受的 ExecuteType，按位组合
+    Wire<bool> port_ready[Ports + 1];  // 端口后的功能单元本周期能否接收
+    // load 的分派条件，未设置时等 ROB 中更老的 store 地址都已知且不重叠
+    std::function<bool(const RSBus &)> load_ready;
+
+    IssueQueue(const ReorderBuffer<ROBLength> &rob)
+        : rob(rob), occupancy(N + 1) {
+        selection = [&]() { return select(); };
+
+        for (size_t i = 1; i <= N; i++) {
+            entries[i].cdb = LAM(cdb);
+            entries[i].clear = LAM(clear);
+            entries[i].squash = LAM(squash);
+            entries[i].new_instruction = [&, i]() -> RSBus {
+                return new_index == i ? new_instruction : RSBus();
+            };
+            entries[i].dispatched = [&, i]() -> bool {
+                for (size_t index : selection.value()) {
+                    if (index == i) return true;
+                }
+                return false;
+            };
+        }
+    }
 
-    void update() { ins.update(); }
-};
\ No newline at end of file
+    // 返回一个空闲表项的下标，0 表示队列已满
+    size_t freeEntry() const {
+        for (size_t i = 1; i <= N; i++) {
+            if (!entries[i].is_busy()) {
+                return i;
+            }
+        }
+        return 0;
+    }
+
+    // 表项 index（1..N）中操作数已就绪的指令，没有则 reorder_index 为 0
+    RSBus readyInstruction(size_t index) const {
+        const ReservationStation &entry = entries[index];
+        return entry.is_busy() && entry.is_ready() ? entry.instruction()
+                                                   : RSBus();
+    }
+
+    // 本周期经 port 分派出去的指令，没有则 reorder_index 为 0
+    RSBus dispatch(size_t port) {
+        size_t index = selection.value()[port];
+        return index == 0 ? RSBus() : entries[index].instruction();
+    }
+
+    void registerStats(StatRegistry &registry,
+                       const std::string &prefix) const {
+        registry.add(prefix + ".occupancy", "busy issue queue entries per cycle",
+                     occupancy);
+        // 端口 port 记作 port{port - 1}，与内存读口的编号一致
+        for (size_t port = 1; port <= Ports; port++) {
+            registry.add(std::format("{}.port{}.dispatch", prefix, port - 1),
+                         "instructions dispatched through the port",
+                         dispatch_count[port]);
+        }
+    }
+
+    void pull() {
+        if (stats_enabled) {
+            size_t busy = 0;
+            for (size_t i = 1; i <= N; i++) {
+                busy += entries[i].is_busy();
+            }
+            occupancy.sample(busy);
+            for (size_t port = 1; port <= Ports; port++) {
+                dispatch_count[port] += selection.value()[port] != 0;
+            }
+        }
+
+        for (size_t i = 1; i <= N; i++) {
+            entries[i].pull();
+        }
+    }
+
+    void update() {
+        for (size_t i = 1; i <= N; i++) {
+            entries[i].update();
+        }
+    }
+
+    void reset() {
+        for (size_t i = 1; i <= N; i++) {
+            entries[i].reset();
+        }
+        occupancy.reset();
+        for (auto &count : dispatch_count) {
+            count.reset();
+        }
+    }
+};
@@ -1,44 +1,207 @@
 #include <cstdio>
+#include <cstring>
+#include <exception>
 #include <format>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 #include "CPU.hpp"
 #include "predictor.hpp"
+#include "reuse_profile.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 #include "utils.hpp"
 
-size_t wire_time = 1;
+enum StatsFormat { NoStats, TextStats, JsonStats };
+
+// 读取批量模式的程序列表，每行一个路径，忽略空行和 # 开头的行
+std::vector<std::string> readProgramList(const std::string &path) {
+    std::ifstream list(path);
+    if (!list) {
+        throw std::runtime_error(std::format("Cannot open {}!", path));
+    }
+
+    std::vector<std::string> programs;
+    std::string line;
+    while (std::getline(list, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        programs.push_back(line);
+    }
+    return programs;
+}
+
+int main(int argc, char *argv[]) {
+    StatsFormat stats_format = NoStats;
+    std::string stats_file;
+    std::string trace_file;
+    std::string address_trace_file;
+    bool trace_fetches = false;
+    std::string branch_trace_file;
+    size_t reuse_line = 0;
+    size_t reuse_window = 1024;
+    std::string batch_file;
+    size_t max_cycles = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--stats" || arg == "--stats=text") {
+            stats_format = TextStats;
+        } else if (arg == "--stats=json") {
+            stats_format = JsonStats;
+        } else if (arg.starts_with("--stats-file=")) {
+            stats_file = arg.substr(std::strlen("--stats-file="));
+        } else if (arg.starts_with("--trace=")) {
+            trace_file = arg.substr(std::strlen("--trace="));
+        } else if (arg.starts_with("--address-trace=")) {
+            address_trace_file = arg.substr(std::strlen("--address-trace="));
+        } else if (arg == "--trace-fetches") {
+            trace_fetches = true;
+        } else if (arg.starts_with("--branch-trace=")) {
+            branch_trace_file = arg.substr(std::strlen("--branch-trace="));
+        } else if (arg == "--reuse-profile") {
+            reuse_line = 64;
+        } else if (arg.starts_with("--reuse-profile=")) {
+            reuse_line =
+                std::stoull(arg.substr(std::strlen("--reuse-profile=")));
+            if (reuse_line == 0 || (reuse_line & (reuse_line - 1)) != 0) {
+                std::cerr << "Line size must be a power of two!" << std::endl;
+                return 1;
+            }
+        } else if (arg.starts_with("--reuse-window=")) {
+            reuse_window =
+                std::stoull(arg.substr(std::strlen("--reuse-window=")));
+            if (reuse_window == 0) {
+                std::cerr << "Window must be at least one access!" << std::endl;
+                return 1;
+            }
+        } else if (arg.starts_with("--batch=")) {
+            batch_file = arg.substr(std::strlen("--batch="));
+        } else if (arg.starts_with("--max-cycles=")) {
+            max_cycles = std::stoull(arg.substr(std::strlen("--max-cycles=")));
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--stats[=text|json]] [--stats-file=PATH]"
+                         " [--trace=PATH] [--address-trace=PATH]"
+                         " [--trace-fetches] [--branch-trace=PATH]"
+                         " [--reuse-profile[=LINE]] [--reuse-window=N]"
+                         " [--max-cycles=N]"
+                         " (--batch=LIST | < program)"
+                      << std::endl;
+            return 1;
+        }
+    }
+    stats_enabled = stats_format != NoStats;
 
-int main() {
     typedef CorrelatingPredictor<5, 5> Predictor1;
     typedef CorrelatingPredictor<0, 10> Predictor2;
     typedef TournamentPredictor<5, Predictor1, Predictor2> MixedPredictor;
     typedef CacheMemory<4, 4, 4, 0, 2> Cache;
 
-    CPU<Predictor1, Cache, 8, 4, 4> cpu;
-    uint8_t ret;
-    while (!cpu.step(ret)) {
-        wire_time++;
-    }
-    std::cout << +ret << std::endl;
-
-#ifdef PROFILE
-    auto ps = cpu.predictorStatistics();
-    auto ms = cpu.memoryStatistics();
-    std::cout << std::format(
-                     "Cycle time: {};\ntotal branch num: {}, correct branch "
-                     "count: {}, "
-                     "correct ratio: {};\ntotal jalr num: {}, correct jalr "
-                     "count: {}, correct ratio: {};\ntotal read count: {}, "
-                     "cache hit count: "
-                     "{}, ratio: {};\ntotal write count: {}.",
-                     cpu.cycleTime(), ps.total_branch, ps.correct_branch,
-                     1.0 * ps.correct_branch / ps.total_branch, ps.total_jalr,
-                     ps.correct_jalr, 1.0 * ps.correct_jalr / ps.total_jalr,
-                     ms.total_read_count, ms.read_cache_hit_count,
-                     ms.read_cache_hit_count * 1.0 / ms.total_read_count,
-                     ms.total_write_count)
-              << std::endl;
-#endif
-
-    return 0;
-}
\ No newline at end of file
+    CPU<Predictor1, Cache, 8, 8, 4> cpu;
+    std::unique_ptr<CommitTraceWriter> trace;
+    if (!trace_file.empty()) {
+        trace = std::make_unique<CommitTraceWriter>(trace_file);
+        cpu.setCommitTrace(trace.get());
+    }
+    // 访存地址轨迹供 cache_sweep 离线评估各种缓存配置
+    std::unique_ptr<AddressTraceWriter> address_trace;
+    if (!address_trace_file.empty()) {
+        address_trace = std::make_unique<AddressTraceWriter>(
+            address_trace_file, trace_fetches);
+        cpu.setAddressTrace(address_trace.get());
+    }
+    // 分支轨迹供 branch_eval 离线比较各种分支预测器
+    std::unique_ptr<BranchTraceWriter> branch_trace;
+    if (!branch_trace_file.empty()) {
+        branch_trace = std::make_unique<BranchTraceWriter>(branch_trace_file);
+        cpu.setBranchTrace(branch_trace.get());
+    }
+
+    // 与缓存配置无关的局部性剖析，随 --stats 输出。重用距离超过 32 KiB
+    // 的访问按 PC 另计
+    std::unique_ptr<ReuseProfiler> reuse_profiler;
+    if (reuse_line != 0) {
+        reuse_profiler = std::make_unique<ReuseProfiler>(
+            reuse_line, reuse_window, 32768 / reuse_line);
+        cpu.setReuseProfiler(reuse_profiler.get());
+    }
+
+    StatRegistry registry;
+    cpu.registerStats(registry);
+    if (reuse_profiler) {
+        reuse_profiler->registerStats(registry, "reuse");
+    }
+    std::ofstream file;
+    if (!stats_file.empty()) {
+        file.open(stats_file);
+    }
+    std::ostream &stats_os = stats_file.empty() ? std::cerr : file;
+
+    auto run = [&]() -> uint8_t {
+        uint8_t ret;
+        while (!cpu.step(ret)) {
+            wire_time++;
+            if (max_cycles != 0 && cpu.cycleTime() >= max_cycles) {
+                throw std::runtime_error(std::format(
+                    "Cycle limit {} exceeded!", max_cycles));
+            }
+        }
+        return ret;
+    };
+
+    if (batch_file.empty()) {
+        cpu.load(std::cin);
+        std::cout << +run() << std::endl;
+
+        if (stats_format == JsonStats) {
+            registry.dumpJson(stats_os);
+        } else if (stats_format == TextStats) {
+            registry.dumpText(stats_os);
+        }
+        return 0;
+    }
+
+    // 批量模式：同一个 CPU 依次运行列表中的程序，每个程序之前 reset
+    auto programs = readProgramList(batch_file);
+    int exit_code = 0;
+    if (stats_format == JsonStats) stats_os << "[";
+    for (size_t i = 0; i < programs.size(); i++) {
+        const std::string &program = programs[i];
+        std::string result;
+        try {
+            std::ifstream in(program);
+            if (!in) {
+                throw std::runtime_error(
+                    std::format("Cannot open {}!", program));
+            }
+            cpu.load(in);
+            result = std::to_string(run());
+        } catch (const std::exception &e) {
+            result = std::format("error: {}", e.what());
+            exit_code = 1;
+            cpu.reset();
+        }
+        std::cout << program << ' ' << result << std::endl;
+
+        if (stats_format == JsonStats) {
+            stats_os << (i == 0 ? "\n" : ",\n")
+                     << std::format(
+                            "  {{\"program\": {}, \"result\": {}, "
+                            "\"stats\": ",
+                            StatRegistry::jsonString(program),
+                            StatRegistry::jsonString(result));
+            registry.dumpJson(stats_os, 2);
+            stats_os << "}";
+        } else if (stats_format == TextStats) {
+            stats_os << std::format("# {}: {}\n", program, result);
+            registry.dumpText(stats_os);
+        }
+    }
+    if (stats_format == JsonStats) stats_os << "\n]\n";
+
+    return exit_code;
+}
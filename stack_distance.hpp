@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// 第一次访问或超出记录深度的栈距离
+constexpr size_t infiniteDistance = SIZE_MAX;
+
+// LRU 栈距离：两次访问同一行之间访问过的不同行数。距离为 d 的访问在容量
+// 大于 d 行的全相联 LRU 缓存中命中（Mattson 的包含性质），一遍就得到所有
+// 容量的命中率。按访问时刻建树状数组，每行只在最近一次访问的时刻记 1，
+// 区间和即不同行数
+class StackDistance {
+    std::vector<size_t> tree;  // 下标为时刻，从 1 开始
+    std::unordered_map<uint64_t, size_t> last;  // 每行最近一次访问的时刻
+    size_t now;
+
+    void add(size_t time, size_t delta) {
+        for (; time < tree.size(); time += time & -time) {
+            tree[time] += delta;
+        }
+    }
+
+    size_t prefix(size_t time) const {
+        size_t sum = 0;
+        for (; time > 0; time -= time & -time) {
+            sum += tree[time];
+        }
+        return sum;
+    }
+
+    // 时刻用完时按最近访问的先后重新编号为 1..行数
+    void compact() {
+        std::vector<std::pair<size_t, uint64_t>> order;
+        order.reserve(last.size());
+        for (const auto &[line, time] : last) {
+            order.emplace_back(time, line);
+        }
+        std::sort(order.begin(), order.end());
+
+        tree.assign(std::max<size_t>(2 * order.size() + 2, 1 << 16), 0);
+        for (size_t i = 0; i < order.size(); i++) {
+            last[order[i].second] = i + 1;
+            add(i + 1, 1);
+        }
+        now = order.size();
+    }
+
+   public:
+    StackDistance() { reset(); }
+
+    // 访问第 line 行，返回栈距离
+    size_t access(uint64_t line) {
+        if (now + 1 >= tree.size()) {
+            compact();
+        }
+        now++;
+
+        size_t distance = infiniteDistance;
+        auto found = last.find(line);
+        if (found != last.end()) {
+            distance = prefix(now - 1) - prefix(found->second);
+            add(found->second, size_t(0) - 1);
+            found->second = now;
+        } else {
+            last.emplace(line, now);
+        }
+        add(now, 1);
+        return distance;
+    }
+
+    void reset() {
+        tree.assign(1 << 16, 0);
+        last.clear();
+        now = 0;
+    }
+};
+
+// 组相联 LRU 的栈距离：每组一个按最近访问排序的栈，只保留前 depth 项。组内距离
+// 为 d 的访问在相联度大于 d 的同组数缓存中命中，一遍得到 depth 以内的所有相联度
+class SetStackDistance {
+    size_t sets;
+    size_t depth;
+    // 第 set 组占 stacks[set * depth, (set + 1) * depth)
+    std::vector<uint64_t> stacks;
+    std::vector<size_t> sizes;
+
+   public:
+    // sets 为 2 的幂
+    SetStackDistance(size_t sets, size_t depth)
+        : sets(sets), depth(depth), stacks(sets * depth), sizes(sets) {}
+
+    // 访问第 line 行，返回组内栈距离，不在前 depth 项中时为 infiniteDistance
+    size_t access(uint64_t line) {
+        size_t set = line & (sets - 1);
+        uint64_t *stack = &stacks[set * depth];
+        size_t &size = sizes[set];
+
+        size_t distance = 0;
+        while (distance < size && stack[distance] != line) distance++;
+        bool found = distance < size;
+        if (!found && size < depth) size++;
+
+        // 把这一行移到栈顶，其余后移一位
+        size_t end = found ? distance : size - 1;
+        for (size_t i = end; i > 0; i--) {
+            stack[i] = stack[i - 1];
+        }
+        stack[0] = line;
+        return found ? distance : infiniteDistance;
+    }
+};
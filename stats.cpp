@@ -0,0 +1,165 @@
+#include "stats.hpp"
+
+#include <cmath>
+#include <format>
+#include <ostream>
+#include <string>
+
+bool stats_enabled = false;
+
+void StatRegistry::add(const std::string &name, const std::string &desc,
+                       const StatCounter &counter) {
+    entries.push_back(
+        Entry{Counter, name, desc, &counter, nullptr, nullptr, nullptr});
+}
+
+void StatRegistry::add(const std::string &name, const std::string &desc,
+                       const StatHistogram &histogram) {
+    entries.push_back(
+        Entry{Histogram, name, desc, nullptr, &histogram, nullptr, nullptr});
+}
+
+void StatRegistry::add(const std::string &name, const std::string &desc,
+                       const StatTable &table) {
+    entries.push_back(
+        Entry{Table, name, desc, nullptr, nullptr, &table, nullptr});
+}
+
+void StatRegistry::add(const std::string &name, const std::string &desc,
+                       std::function<double(void)> formula) {
+    entries.push_back(
+        Entry{Formula, name, desc, nullptr, nullptr, nullptr, formula});
+}
+
+void StatRegistry::dumpText(std::ostream &os) const {
+    for (const auto &entry : entries) {
+        switch (entry.kind) {
+            case Counter:
+                os << std::format("{:<40} {:>16} # {}\n", entry.name,
+                                  entry.counter->value(), entry.desc);
+                break;
+            case Formula:
+                os << std::format("{:<40} {:>16.6f} # {}\n", entry.name,
+                                  entry.formula(), entry.desc);
+                break;
+            case Histogram: {
+                const StatHistogram &h = *entry.histogram;
+                os << std::format("{:<40} {:>16} # {}\n",
+                                  entry.name + ".samples", h.sampleCount(),
+                                  entry.desc);
+                os << std::format("{:<40} {:>16.6f}\n", entry.name + ".mean",
+                                  h.mean());
+                os << std::format("{:<40} {:>16}\n", entry.name + ".max",
+                                  h.maxValue());
+                const auto &counts = h.counts();
+                for (size_t i = 0; i < counts.size(); i++) {
+                    size_t low = h.bucketLow(i);
+                    size_t high = h.bucketLow(i + 1) - 1;
+                    std::string range = std::format("{}-{}", low, high);
+                    if (i + 1 == counts.size()) {
+                        range = std::format("{}+", low);
+                    } else if (high == low) {
+                        range = std::format("{}", low);
+                    }
+                    os << std::format("{:<40} {:>16}\n",
+                                      entry.name + "::" + range, counts[i]);
+                }
+                break;
+            }
+            case Table: {
+                const StatTable &t = *entry.table;
+                os << std::format("{:<40} {:>16} # {}\n",
+                                  entry.name + ".total", t.total(),
+                                  entry.desc);
+                for (const auto &[key, count] : t.entries()) {
+                    os << std::format("{:<40} {:>16}\n",
+                                      std::format("{}::0x{:08X}", entry.name,
+                                                  key),
+                                      count);
+                }
+                break;
+            }
+        }
+    }
+}
+
+std::string StatRegistry::jsonString(const std::string &s) {
+    std::string ret = "\"";
+    for (char c : s) {
+        switch (c) {
+            case '"':
+                ret += "\\\"";
+                break;
+            case '\\':
+                ret += "\\\\";
+                break;
+            case '\n':
+                ret += "\\n";
+                break;
+            case '\t':
+                ret += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    ret += std::format("\\u{:04x}", int(c));
+                } else {
+                    ret += c;
+                }
+        }
+    }
+    return ret + "\"";
+}
+
+void StatRegistry::dumpJson(std::ostream &os, size_t indent) const {
+    std::string pad(indent, ' ');
+
+    auto number = [](double x) {
+        return std::isfinite(x) ? std::format("{}", x) : std::string("null");
+    };
+
+    os << "{";
+    for (size_t i = 0; i < entries.size(); i++) {
+        const auto &entry = entries[i];
+        os << (i == 0 ? "\n" : ",\n") << pad
+           << std::format("  {}: ", jsonString(entry.name));
+        switch (entry.kind) {
+            case Counter:
+                os << entry.counter->value();
+                break;
+            case Formula:
+                os << number(entry.formula());
+                break;
+            case Histogram: {
+                const StatHistogram &h = *entry.histogram;
+                os << std::format(
+                    "{{\"samples\": {}, \"mean\": {}, \"max\": {}, {}, "
+                    "\"buckets\": [",
+                    h.sampleCount(), number(h.mean()), h.maxValue(),
+                    h.bucketScale() == StatHistogram::Log2
+                        ? std::string("\"scale\": \"log2\"")
+                        : std::format("\"bucket_width\": {}", h.width()));
+                const auto &counts = h.counts();
+                for (size_t j = 0; j < counts.size(); j++) {
+                    os << (j == 0 ? "" : ", ") << counts[j];
+                }
+                os << "]}";
+                break;
+            }
+            case Table: {
+                const StatTable &t = *entry.table;
+                os << std::format("{{\"total\": {}, \"entries\": {{",
+                                  t.total());
+                bool first = true;
+                for (const auto &[key, count] : t.entries()) {
+                    os << (first ? "" : ", ")
+                       << std::format("\"0x{:08X}\": {}", key, count);
+                    first = false;
+                }
+                os << "}}";
+                break;
+            }
+        }
+    }
+    os << "\n" << pad << "}";
+    if (indent == 0) os << "\n";
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// 运行时统计开关，由命令行参数设置；关闭时各部件不做任何统计工作
+extern bool stats_enabled;
+
+class StatCounter {
+    size_t count;
+
+   public:
+    StatCounter() : count(0) {}
+    StatCounter &operator++() {
+        count++;
+        return *this;
+    }
+    StatCounter &operator+=(size_t n) {
+        count += n;
+        return *this;
+    }
+    size_t value() const { return count; }
+    operator size_t() const { return count; }
+    void reset() { count = 0; }
+};
+
+// 分桶的直方图，超出范围的样本计入最后一个桶。Linear 时每桶等宽；
+// Log2 时第 0 桶为 0，第 i 桶为 [2^(i-1), 2^i)，用于跨越多个数量级的量
+class StatHistogram {
+   public:
+    enum Scale { Linear, Log2 };
+
+   private:
+    size_t bucket_width;
+    Scale scale;
+    std::vector<size_t> buckets;
+    size_t samples;
+    size_t sum;
+    size_t max;
+
+   public:
+    StatHistogram(size_t bucket_count, size_t bucket_width = 1,
+                  Scale scale = Linear)
+        : bucket_width(bucket_width),
+          scale(scale),
+          buckets(bucket_count),
+          samples(0),
+          sum(0),
+          max(0) {}
+
+    void sample(size_t value) {
+        size_t bucket =
+            scale == Log2 ? std::bit_width(value) : value / bucket_width;
+        buckets[bucket < buckets.size() ? bucket : buckets.size() - 1]++;
+        samples++;
+        sum += value;
+        if (value > max) max = value;
+    }
+
+    void reset() {
+        std::fill(buckets.begin(), buckets.end(), 0);
+        samples = sum = max = 0;
+    }
+
+    // 第 i 桶的下界
+    size_t bucketLow(size_t i) const {
+        if (scale == Log2) return i == 0 ? 0 : size_t(1) << (i - 1);
+        return i * bucket_width;
+    }
+
+    size_t width() const { return bucket_width; }
+    Scale bucketScale() const { return scale; }
+    const std::vector<size_t> &counts() const { return buckets; }
+    size_t sampleCount() const { return samples; }
+    size_t maxValue() const { return max; }
+    double mean() const { return samples ? 1.0 * sum / samples : 0; }
+};
+
+// 按键（如 load 指令的地址）分开计数，只保存出现过的键
+class StatTable {
+    std::map<uint32_t, size_t> counts;
+
+   public:
+    void add(uint32_t key, size_t n = 1) { counts[key] += n; }
+    void reset() { counts.clear(); }
+    const std::map<uint32_t, size_t> &entries() const { return counts; }
+    size_t total() const {
+        size_t sum = 0;
+        for (const auto &[key, count] : counts) sum += count;
+        return sum;
+    }
+};
+
+// 统计项登记处，各部件把自己的统计量以层级名字（如 "mem.read"）注册进来
+class StatRegistry {
+    enum Kind { Counter, Histogram, Table, Formula };
+
+    struct Entry {
+        Kind kind;
+        std::string name;
+        std::string desc;
+        const StatCounter *counter;
+        const StatHistogram *histogram;
+        const StatTable *table;
+        std::function<double(void)> formula;
+    };
+
+    std::vector<Entry> entries;
+
+   public:
+    void add(const std::string &name, const std::string &desc,
+             const StatCounter &counter);
+    void add(const std::string &name, const std::string &desc,
+             const StatHistogram &histogram);
+    void add(const std::string &name, const std::string &desc,
+             const StatTable &table);
+    void add(const std::string &name, const std::string &desc,
+             std::function<double(void)> formula);
+
+    void dumpText(std::ostream &os) const;
+    // indent 为嵌入到外层 JSON 时除首行外每行的缩进
+    void dumpJson(std::ostream &os, size_t indent = 0) const;
+    // 加上引号并转义的 JSON 字符串
+    static std::string jsonString(const std::string &s);
+
+    static double ratio(size_t numerator, size_t denominator) {
+        return denominator ? 1.0 * numerator / denominator : 0;
+    }
+};
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "bus.hpp"
+#include "stats.hpp"
+#include "utils.hpp"
+
+// 提交后的 store 缓冲：已提交的 store 先写进这里，再在后台逐个写回内存。
+// 每个表项是一个对齐的 2^b 字节块，落在同一块里的 store 合并进同一表项。
+// 每周期从最老的表项中写回一段自然对齐的字、半字或字节
+template <size_t N, size_t b>
+    requires(N > 0 && b >= 2 && b <= 6)
+class StoreBuffer : public Updatable {
+    constexpr static size_t B = 1 << b;
+
+    struct Entry {
+        bool valid;
+        uint32_t address;  // 块首地址
+        uint64_t mask;     // 每字节一位，标记尚未写回的字节
+        uint8_t data[B];
+    };
+
+    Reg<Entry> entries[N];  // entries[0] 最老
+
+    StatHistogram occupancy;
+    StatCounter store_count;
+    StatCounter coalesce_count;
+    StatCounter drain_count;
+    StatCounter drain_stall_count;
+    StatCounter forward_count;
+
+    // 最老的表项中下一段要写回的数据，以及本周期实际写回的一段
+    Wire<MemBus> piece;
+    Wire<MemBus> drain_bus;
+    // 写回后最老的表项是否已空
+    Wire<bool> drain_done;
+    // 提交的 store 在本周期结束后所在的表项，N 表示没有 store
+    Wire<size_t> target;
+
+    static uint8_t width(uint8_t mode) {
+        return mode & 0b010U ? 4 : mode & 0b001U ? 2 : 1;
+    }
+
+    static uint64_t pieceMask(size_t offset, uint8_t mode) {
+        return ((uint64_t(1) << width(mode)) - 1) << offset;
+    }
+
+    size_t count() const {
+        size_t result = 0;
+        while (result < N && Entry(entries[result]).valid) {
+            result++;
+        }
+        return result;
+    }
+
+    // 可以合并 address 所在块的表项，找不到返回 N
+    size_t findBlock(uint32_t address) {
+        uint32_t block = address & ~uint32_t(B - 1);
+        for (size_t i = 0; i < N; i++) {
+            const Entry &entry = entries[i];
+            if (!entry.valid) break;
+            if (entry.address == block && !(i == 0 && drain_done)) {
+                return i;
+            }
+        }
+        return N;
+    }
+
+    MemBus drain() const {
+        const Entry &entry = entries[0];
+        if (!entry.valid) {
+            return MemBus();
+        }
+
+        size_t offset = 0;
+        while (!(entry.mask >> offset & 1)) {
+            offset++;
+        }
+
+        uint8_t mode = 0b000U;
+        if (offset % 4 == 0 && offset + 4 <= B &&
+            (entry.mask & pieceMask(offset, 0b010U)) ==
+                pieceMask(offset, 0b010U)) {
+            mode = 0b010U;
+        } else if (offset % 2 == 0 && offset + 2 <= B &&
+                   (entry.mask & pieceMask(offset, 0b001U)) ==
+                       pieceMask(offset, 0b001U)) {
+            mode = 0b001U;
+        }
+
+        uint32_t data = 0;
+        for (size_t i = 0; i < width(mode); i++) {
+            data |= uint32_t(entry.data[offset + i]) << (8 * i);
+        }
+        // reorder_index 只作为有效标志
+        return MemBus{
+            1, mode, uint32_t(entry.address + offset), data, false, 0};
+    }
+
+   public:
+    enum ForwardResult { NoForward, FullForward, PartialForward };
+
+    Wire<MemBus> store;      // 本周期提交的 store
+    Wire<size_t> forwarded;  // 本周期用上转发数据的 load 数，仅用于统计
+    Wire<bool> write_ready;  // 内存本周期能否接收 nextWrite()
+
+    StoreBuffer() : occupancy(N + 1) {
+        piece = [&]() { return drain(); };
+        drain_bus = [&]() -> MemBus {
+            return write_ready ? piece : MemBus();
+        };
+        drain_done = [&]() -> bool {
+            MemBus db = drain_bus;
+            return db.reorder_index != 0 &&
+                   (Entry(entries[0]).mask &
+                    ~pieceMask(db.address & (B - 1), db.mode)) == 0;
+        };
+        target = [&]() -> size_t {
+            MemBus sb = store;
+            if (sb.reorder_index == 0) {
+                return N;
+            }
+
+            size_t index = findBlock(sb.address);
+            if (index == N) {
+                index = count();
+            }
+            return drain_done ? index - 1 : index;
+        };
+
+        for (size_t i = 0; i < N; i++) {
+            entries[i] <= [&, i]() -> Entry {
+                Entry entry;
+                if (drain_done) {
+                    entry = i + 1 < N ? Entry(entries[i + 1]) : Entry{};
+                } else {
+                    entry = entries[i];
+                    MemBus db = drain_bus;
+                    if (i == 0 && db.reorder_index != 0) {
+                        entry.mask &=
+                            ~pieceMask(db.address & (B - 1), db.mode);
+                    }
+                }
+
+                if (target == i) {
+                    MemBus sb = store;
+                    if (!entry.valid) {
+                        entry = Entry{true, sb.address & ~uint32_t(B - 1), 0,
+                                      {}};
+                    }
+                    size_t offset = sb.address & (B - 1);
+                    for (size_t j = 0; j < width(sb.mode); j++) {
+                        entry.data[offset + j] = (sb.input >> (8 * j)) & 0xff;
+                    }
+                    entry.mask |= pieceMask(offset, sb.mode);
+                }
+
+                return entry;
+            };
+        }
+    }
+
+    // 本周期能否接收写 address 的 store
+    bool canAccept(uint32_t address) {
+        return findBlock(address) != N || count() - drain_done < N;
+    }
+
+    // 下一段等待写回的数据，没有则 reorder_index 为 0
+    MemBus nextWrite() { return piece; }
+
+    // 本周期写回内存的总线
+    MemBus writeBack() { return drain_bus; }
+
+    // 查询读 address 的 load 能否从缓冲中取得全部数据；FullForward 时数据写入
+    // data（未扩展），PartialForward 表示只有部分字节在缓冲中
+    ForwardResult forward(uint32_t address, uint8_t mode,
+                          uint32_t &data) const {
+        size_t found = 0;
+        data = 0;
+        for (size_t i = 0; i < width(mode); i++) {
+            uint32_t byte_address = address + i;
+            uint32_t block = byte_address & ~uint32_t(B - 1);
+            size_t offset = byte_address & (B - 1);
+            for (size_t j = 0; j < N; j++) {
+                const Entry &entry = entries[j];
+                if (!entry.valid) break;
+                if (entry.address == block && (entry.mask >> offset & 1)) {
+                    data |= uint32_t(entry.data[offset]) << (8 * i);
+                    found++;
+                    break;
+                }
+            }
+        }
+
+        if (found == 0) {
+            return NoForward;
+        }
+        return found == width(mode) ? FullForward : PartialForward;
+    }
+
+    void registerStats(StatRegistry &registry,
+                       const std::string &prefix) const {
+        registry.add(prefix + ".occupancy", "busy store buffer entries per cycle",
+                     occupancy);
+        registry.add(prefix + ".store", "committed stores written to the buffer",
+                     store_count);
+        registry.add(prefix + ".coalesce",
+                     "stores merged into an existing entry", coalesce_count);
+        registry.add(prefix + ".drain", "writes sent to memory", drain_count);
+        registry.add(prefix + ".drain_stall",
+                     "cycles a pending write was refused by memory",
+                     drain_stall_count);
+        registry.add(prefix + ".forward", "loads served from the buffer",
+                     forward_count);
+    }
+
+    void pull() {
+        if (stats_enabled) {
+            occupancy.sample(count());
+            MemBus sb = store;
+            if (sb.reorder_index != 0) {
+                ++store_count;
+                coalesce_count += findBlock(sb.address) != N;
+            }
+            drain_count += drain_bus.value().reorder_index != 0;
+            drain_stall_count += piece.value().reorder_index != 0 &&
+                                 drain_bus.value().reorder_index == 0;
+            forward_count += forwarded;
+        }
+
+        for (auto &entry : entries) {
+            entry.pull();
+        }
+    }
+
+    void update() {
+        for (auto &entry : entries) {
+            entry.update();
+        }
+    }
+
+    void reset() {
+        for (auto &entry : entries) {
+            entry.reset();
+        }
+        occupancy.reset();
+        store_count.reset();
+        coalesce_count.reset();
+        drain_count.reset();
+        drain_stall_count.reset();
+        forward_count.reset();
+    }
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// 一组缓存行的查找结果：命中的路和第一个空闲的路，找不到时为 ways。
+// 命中时不保证 free 已经找到
+struct TagMatch {
+    size_t hit;
+    size_t free;
+};
+
+// 标记按 (mark << 1) | 1 打包，0 表示无效行，因此一次比较同时查命中与空闲
+constexpr uint32_t packTag(uint32_t mark) { return (mark << 1) | 1U; }
+
+inline TagMatch matchTagsScalar(const uint32_t *tags, size_t ways,
+                                uint32_t key) {
+    TagMatch result{ways, ways};
+    for (size_t i = 0; i < ways; i++) {
+        if (result.hit == ways && tags[i] == key) result.hit = i;
+        if (result.free == ways && tags[i] == 0) result.free = i;
+    }
+    return result;
+}
+
+// 在 tags[0, ways) 中查找 key，按编译目标选用 AVX2、SSE2 或逐项比较
+inline TagMatch matchTags(const uint32_t *tags, size_t ways, uint32_t key) {
+    TagMatch result{ways, ways};
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i key8 = _mm256_set1_epi32(int(key));
+    const __m256i zero8 = _mm256_setzero_si256();
+    for (; i + 8 <= ways; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(tags + i));
+        unsigned hit = _mm256_movemask_ps(
+            _mm256_castsi256_ps(_mm256_cmpeq_epi32(v, key8)));
+        unsigned free = _mm256_movemask_ps(
+            _mm256_castsi256_ps(_mm256_cmpeq_epi32(v, zero8)));
+        if (hit && result.hit == ways) result.hit = i + __builtin_ctz(hit);
+        if (free && result.free == ways) result.free = i + __builtin_ctz(free);
+        if (result.hit != ways) return result;
+    }
+#endif
+
+#if defined(__SSE2__)
+    const __m128i key4 = _mm_set1_epi32(int(key));
+    const __m128i zero4 = _mm_setzero_si128();
+    for (; i + 4 <= ways; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(tags + i));
+        unsigned hit =
+            _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, key4)));
+        unsigned free =
+            _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, zero4)));
+        if (hit && result.hit == ways) result.hit = i + __builtin_ctz(hit);
+        if (free && result.free == ways) result.free = i + __builtin_ctz(free);
+        if (result.hit != ways) return result;
+    }
+#endif
+
+    if (i < ways) {
+        TagMatch rest = matchTagsScalar(tags + i, ways - i, key);
+        if (result.hit == ways && rest.hit != ways - i) {
+            result.hit = i + rest.hit;
+        }
+        if (result.free == ways && rest.free != ways - i) {
+            result.free = i + rest.free;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,340 @@
+#include "trace.hpp"
+
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+BufferedWriter::BufferedWriter(const std::string &path, size_t capacity)
+    : file(path, std::ios::binary),
+      capacity(capacity),
+      pending(false),
+      stopping(false) {
+    if (!file) {
+        throw std::runtime_error(
+            std::format("Cannot open {} for writing!", path));
+    }
+    filling.reserve(capacity);
+    writing.reserve(capacity);
+    worker = std::thread(&BufferedWriter::run, this);
+}
+
+BufferedWriter::~BufferedWriter() {
+    handOver();
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    worker.join();
+}
+
+void BufferedWriter::run() {
+    std::unique_lock lock(mutex);
+    while (true) {
+        cv.wait(lock, [&]() { return pending || stopping; });
+        if (pending) {
+            lock.unlock();
+            file.write(reinterpret_cast<const char *>(writing.data()),
+                       writing.size());
+            writing.clear();
+            lock.lock();
+            pending = false;
+            cv.notify_all();
+        } else {
+            break;
+        }
+    }
+    file.flush();
+}
+
+// 等后台线程写完上一块，再把当前块交给它
+void BufferedWriter::handOver() {
+    std::unique_lock lock(mutex);
+    cv.wait(lock, [&]() { return !pending; });
+    std::swap(filling, writing);
+    pending = true;
+    cv.notify_all();
+}
+
+void BufferedWriter::write(const void *data, size_t size) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    filling.insert(filling.end(), bytes, bytes + size);
+    if (filling.size() >= capacity) handOver();
+}
+
+bool readVarint(std::istream &is, uint64_t &value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = is.get();
+        if (byte == EOF) return false;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool readU32(std::istream &is, uint32_t &value) {
+    uint8_t bytes[4];
+    if (!is.read(reinterpret_cast<char *>(bytes), 4)) return false;
+    value = bytes[0] | bytes[1] << 8 | bytes[2] << 16 |
+            static_cast<uint32_t>(bytes[3]) << 24;
+    return true;
+}
+
+CommitTraceWriter::CommitTraceWriter(const std::string &path) : out(path) {
+    out.write(magic, sizeof(magic));
+    out.putU32(version);
+}
+
+void CommitTraceWriter::commit(const CommitRecord &record) {
+    uint8_t flags = 0;
+    if (record.PC != last_PC + 4) flags |= NonSequential;
+
+    auto found = instructions.find(record.PC);
+    if (found == instructions.end() || found->second != record.instruction) {
+        flags |= NewInstruction;
+        instructions[record.PC] = record.instruction;
+    }
+    if (record.rd != 0) flags |= RegWrite;
+    if (record.mem_type == CommitRecord::Load) flags |= LoadAccess;
+    if (record.mem_type == CommitRecord::Store) flags |= StoreAccess;
+    flags |= (record.mode & 0b111) << ModeShift;
+
+    out.put(flags);
+    if (flags & NonSequential) {
+        out.putVarint(zigzag(int64_t(record.PC) - int64_t(last_PC + 4)));
+    }
+    if (flags & NewInstruction) {
+        out.putU32(record.instruction);
+    }
+    if (flags & RegWrite) {
+        out.put(record.rd);
+        out.putVarint(zigzag(int32_t(record.value - regs[record.rd])));
+        regs[record.rd] = record.value;
+    }
+    if (flags & (LoadAccess | StoreAccess)) {
+        out.putVarint(zigzag(int32_t(record.address - last_address)));
+        last_address = record.address;
+    }
+    if (flags & StoreAccess) {
+        out.putVarint(record.data);
+    }
+    last_PC = record.PC;
+}
+
+CommitTraceReader::CommitTraceReader(const std::string &path)
+    : in(path, std::ios::binary) {
+    char header[sizeof(magic)];
+    uint32_t file_version;
+    if (!in.read(header, sizeof(header)) ||
+        std::memcmp(header, magic, sizeof(magic)) != 0 ||
+        !readU32(in, file_version)) {
+        throw std::runtime_error(
+            std::format("{} is not a commit trace!", path));
+    }
+    if (file_version != version) {
+        throw std::runtime_error(std::format(
+            "Unsupported commit trace version {} in {}!", file_version, path));
+    }
+}
+
+bool CommitTraceReader::next(CommitRecord &record) {
+    int flags = in.get();
+    if (flags == EOF) return false;
+
+    auto truncated = []() {
+        return std::runtime_error("The commit trace is truncated!");
+    };
+
+    record = CommitRecord();
+    record.PC = last_PC + 4;
+    if (flags & NonSequential) {
+        uint64_t delta;
+        if (!readVarint(in, delta)) throw truncated();
+        record.PC += unzigzag(delta);
+    }
+    if (flags & NewInstruction) {
+        if (!readU32(in, record.instruction)) throw truncated();
+        instructions[record.PC] = record.instruction;
+    } else {
+        record.instruction = instructions[record.PC];
+    }
+    if (flags & RegWrite) {
+        uint64_t delta;
+        int rd = in.get();
+        if (rd == EOF || !readVarint(in, delta)) throw truncated();
+        record.rd = rd & 0b11111;
+        record.value = regs[record.rd] + uint32_t(unzigzag(delta));
+        regs[record.rd] = record.value;
+    }
+    record.mode = (flags >> ModeShift) & 0b111;
+    if (flags & (LoadAccess | StoreAccess)) {
+        uint64_t delta;
+        if (!readVarint(in, delta)) throw truncated();
+        record.address = last_address + uint32_t(unzigzag(delta));
+        last_address = record.address;
+        record.mem_type =
+            flags & LoadAccess ? CommitRecord::Load : CommitRecord::Store;
+    }
+    if (flags & StoreAccess) {
+        uint64_t data;
+        if (!readVarint(in, data)) throw truncated();
+        record.data = data;
+    }
+    last_PC = record.PC;
+    return true;
+}
+
+AddressTraceWriter::AddressTraceWriter(const std::string &path, bool fetches)
+    : out(path) {
+    this->fetches = fetches;
+    out.write(magic, sizeof(magic));
+    out.putU32(version);
+    out.put(fetches);
+}
+
+void AddressTraceWriter::put(AddressRecord::Kind kind, uint32_t address) {
+    out.putVarint(zigzag(int32_t(address - last_address[kind])) << 2 | kind);
+    last_address[kind] = address;
+}
+
+void AddressTraceWriter::commit(const CommitRecord &record) {
+    if (fetches) {
+        put(AddressRecord::Fetch, record.PC);
+    }
+    if (record.mem_type == CommitRecord::Load) {
+        put(AddressRecord::Load, record.address);
+    } else if (record.mem_type == CommitRecord::Store) {
+        put(AddressRecord::Store, record.address);
+    }
+}
+
+AddressTraceReader::AddressTraceReader(const std::string &path)
+    : in(path, std::ios::binary) {
+    char header[sizeof(magic)];
+    uint32_t file_version;
+    int options;
+    if (!in.read(header, sizeof(header)) ||
+        std::memcmp(header, magic, sizeof(magic)) != 0 ||
+        !readU32(in, file_version) || (options = in.get()) == EOF) {
+        throw std::runtime_error(
+            std::format("{} is not an address trace!", path));
+    }
+    if (file_version != version) {
+        throw std::runtime_error(std::format(
+            "Unsupported address trace version {} in {}!", file_version, path));
+    }
+    fetches = options & 1;
+}
+
+bool AddressTraceReader::next(AddressRecord &record) {
+    uint64_t value;
+    if (!readVarint(in, value)) return false;
+
+    uint8_t kind = value & 0b11;
+    if (kind > AddressRecord::Store) {
+        throw std::runtime_error("The address trace is corrupted!");
+    }
+    record.kind = AddressRecord::Kind(kind);
+    record.address = last_address[kind] + uint32_t(unzigzag(value >> 2));
+    last_address[kind] = record.address;
+    return true;
+}
+
+BranchTraceWriter::BranchTraceWriter(const std::string &path) : out(path) {
+    out.write(magic, sizeof(magic));
+    out.putU32(version);
+}
+
+BranchTraceWriter::~BranchTraceWriter() {
+    // 程序停在分支上时结果无从得知，只计入指令数
+    if (pending_valid) {
+        gap += pending.instructions;
+    }
+    out.putVarint(End << 1);
+    out.putVarint(gap);
+}
+
+void BranchTraceWriter::put(const BranchRecord &record) {
+    out.putVarint(zigzag(int32_t(record.PC - last_PC)) << 3 |
+                  record.kind << 1 | record.taken);
+    out.putVarint(record.instructions);
+    out.putVarint(zigzag(int32_t(record.target - record.PC)));
+    last_PC = record.PC;
+}
+
+void BranchTraceWriter::commit(const CommitRecord &record) {
+    if (pending_valid) {
+        if (pending.kind == BranchRecord::Branch) {
+            pending.taken = record.PC != pending.PC + 4;
+        } else {
+            pending.target = record.PC;
+        }
+        put(pending);
+        pending_valid = false;
+    }
+
+    gap++;
+    uint32_t instruction = record.instruction;
+    uint8_t op = instruction & 0x7f;
+    if (op == 0b1100011U /* branch */) {
+        uint32_t imm = (instruction & 0x00000080U) << 4 |
+                       (instruction & 0x00000F00U) >> 7 |
+                       (instruction & 0x7E000000U) >> 20 |
+                       (instruction & 0x80000000U) >> 19;
+        imm |= (imm & 0x1000U) ? 0xFFFFE000U : 0;
+        pending = BranchRecord{BranchRecord::Branch, record.PC,
+                               record.PC + imm, false, gap};
+    } else if (op == 0b1100111U /* jalr */) {
+        pending =
+            BranchRecord{BranchRecord::Jalr, record.PC, 0, true, gap};
+    } else {
+        return;
+    }
+    pending_valid = true;
+    gap = 0;
+}
+
+BranchTraceReader::BranchTraceReader(const std::string &path)
+    : in(path, std::ios::binary) {
+    char header[sizeof(magic)];
+    uint32_t file_version;
+    if (!in.read(header, sizeof(header)) ||
+        std::memcmp(header, magic, sizeof(magic)) != 0 ||
+        !readU32(in, file_version)) {
+        throw std::runtime_error(
+            std::format("{} is not a branch trace!", path));
+    }
+    if (file_version != version) {
+        throw std::runtime_error(std::format(
+            "Unsupported branch trace version {} in {}!", file_version, path));
+    }
+}
+
+bool BranchTraceReader::next(BranchRecord &record) {
+    auto truncated = []() {
+        return std::runtime_error("The branch trace is truncated!");
+    };
+
+    uint64_t value, gap;
+    if (!readVarint(in, value) || !readVarint(in, gap)) throw truncated();
+    instructions += gap;
+
+    uint8_t kind = (value >> 1) & 0b11;
+    if (kind == End) {
+        return false;
+    }
+    if (kind > End) {
+        throw std::runtime_error("The branch trace is corrupted!");
+    }
+
+    uint64_t delta;
+    if (!readVarint(in, delta)) throw truncated();
+    record.kind = BranchRecord::Kind(kind);
+    record.PC = last_PC + uint32_t(unzigzag(value >> 3));
+    record.target = record.PC + uint32_t(unzigzag(delta));
+    record.taken = value & 1;
+    record.instructions = gap;
+    last_PC = record.PC;
+    return true;
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// 在后台线程中写文件的缓冲输出，写满一块就交给后台线程，仿真线程不等待磁盘
+class BufferedWriter {
+    std::ofstream file;
+    size_t capacity;
+    std::vector<uint8_t> filling;
+    std::vector<uint8_t> writing;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool pending;
+    bool stopping;
+    std::thread worker;
+
+    void run();
+    void handOver();
+
+   public:
+    BufferedWriter(const std::string &path, size_t capacity = 1 << 20);
+    BufferedWriter(const BufferedWriter &) = delete;
+    BufferedWriter &operator=(const BufferedWriter &) = delete;
+    ~BufferedWriter();
+
+    void put(uint8_t byte) {
+        filling.push_back(byte);
+        if (filling.size() >= capacity) handOver();
+    }
+    void write(const void *data, size_t size);
+    void putVarint(uint64_t value) {
+        while (value >= 0x80) {
+            put(static_cast<uint8_t>(value) | 0x80);
+            value >>= 7;
+        }
+        put(static_cast<uint8_t>(value));
+    }
+    void putU32(uint32_t value) {
+        for (int i = 0; i < 4; i++) put((value >> (8 * i)) & 0xff);
+    }
+};
+
+inline uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ (value < 0 ? ~0ULL : 0);
+}
+
+inline int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+bool readVarint(std::istream &is, uint64_t &value);
+bool readU32(std::istream &is, uint32_t &value);
+
+struct CommitRecord {
+    enum MemType { NoMem, Load, Store };
+
+    uint32_t PC;
+    uint32_t instruction;
+    uint8_t rd;  // 为 0 表示没有写寄存器
+    uint32_t value;
+    MemType mem_type;
+    uint8_t mode;
+    uint32_t address;
+    uint32_t data;  // 仅 Store 有效，只含写入的字节
+};
+
+// 提交轨迹格式：文件头为 8 字节魔数和 4 字节版本号，之后每条提交指令一个记录：
+//   flags (1 byte)
+//   [PC 偏移]     flags & NonSequential：zigzag varint，相对于上一条 PC + 4
+//   [指令]        flags & NewInstruction：4 字节小端；否则沿用该 PC 上次的指令
+//   [rd, 差值]    flags & RegWrite：1 字节 rd，zigzag varint(新值 - 旧值)
+//   [地址, 数据]  flags & Load/Store：zigzag varint(地址 - 上次访存地址)，
+//                 Store 另有 varint 数据；访存宽度 (subop) 存于 flags 高 3 位
+class CommitTrace {
+   public:
+    static constexpr char magic[8] = {'R', 'V', 'C', 'T', 'R', 'A', 'C', 'E'};
+    static constexpr uint32_t version = 1;
+
+    enum Flags : uint8_t {
+        NonSequential = 1 << 0,
+        NewInstruction = 1 << 1,
+        RegWrite = 1 << 2,
+        LoadAccess = 1 << 3,
+        StoreAccess = 1 << 4,
+        ModeShift = 5,
+    };
+
+   protected:
+    uint32_t last_PC = 0 - 4U;
+    uint32_t last_address = 0;
+    uint32_t regs[32] = {};
+    std::unordered_map<uint32_t, uint32_t> instructions;
+};
+
+class CommitTraceWriter : public CommitTrace {
+    BufferedWriter out;
+
+   public:
+    CommitTraceWriter(const std::string &path);
+
+    void commit(const CommitRecord &record);
+};
+
+class CommitTraceReader : public CommitTrace {
+    std::ifstream in;
+
+   public:
+    CommitTraceReader(const std::string &path);
+
+    // 读到文件尾时返回 false
+    bool next(CommitRecord &record);
+
+    uint32_t reg(uint8_t index) const { return regs[index]; }
+};
+
+struct AddressRecord {
+    enum Kind { Fetch, Load, Store };
+
+    Kind kind;
+    uint32_t address;
+};
+
+// 访存地址轨迹格式：文件头为 8 字节魔数、4 字节版本号和 1 字节选项（是否含
+// 取指地址），之后按提交顺序每次访问一个 varint：
+//   (zigzag(地址 - 同类访问的上一个地址) << 2) | 类别
+// 顺序取指与步长固定的访存大多只占 1 字节
+class AddressTrace {
+   public:
+    static constexpr char magic[8] = {'R', 'V', 'A', 'T', 'R', 'A', 'C', 'E'};
+    static constexpr uint32_t version = 1;
+
+   protected:
+    bool fetches = false;
+    uint32_t last_address[3] = {};
+};
+
+class AddressTraceWriter : public AddressTrace {
+    BufferedWriter out;
+
+    void put(AddressRecord::Kind kind, uint32_t address);
+
+   public:
+    // fetches 为 true 时同时记录每条提交指令的地址
+    AddressTraceWriter(const std::string &path, bool fetches);
+
+    // 记下一条提交指令的取指与访存地址
+    void commit(const CommitRecord &record);
+};
+
+class AddressTraceReader : public AddressTrace {
+    std::ifstream in;
+
+   public:
+    AddressTraceReader(const std::string &path);
+
+    bool hasFetches() const { return fetches; }
+
+    // 读到文件尾时返回 false
+    bool next(AddressRecord &record);
+};
+
+struct BranchRecord {
+    enum Kind { Branch, Jalr };
+
+    Kind kind;
+    uint32_t PC;
+    // 条件分支为跳转时的目标（不论是否跳转），jalr 为实际跳到的地址
+    uint32_t target;
+    bool taken;
+    // 自上一个记录以来提交的指令数，包括这一条
+    uint32_t instructions;
+};
+
+// 分支轨迹格式：文件头为 8 字节魔数和 4 字节版本号，之后按提交顺序每条条件
+// 分支和 jalr 一个记录：
+//   (zigzag(PC - 上一个记录的 PC) << 3) | (类别 << 1) | 是否跳转  (varint)
+//   varint(自上一个记录以来提交的指令数)
+//   zigzag varint(目标 - PC)
+// 文件以类别为 End 的记录结尾，只带 PC 差值 0 和最后一段的指令数
+class BranchTrace {
+   public:
+    static constexpr char magic[8] = {'R', 'V', 'B', 'T', 'R', 'A', 'C', 'E'};
+    static constexpr uint32_t version = 1;
+
+    enum { End = 2 };
+
+   protected:
+    uint32_t last_PC = 0;
+    uint64_t instructions = 0;
+};
+
+class BranchTraceWriter : public BranchTrace {
+    BufferedWriter out;
+
+    // 跳转与否、jalr 的目标要看下一条提交的指令，先暂存
+    bool pending_valid = false;
+    BranchRecord pending;
+    uint32_t gap = 0;
+
+    void put(const BranchRecord &record);
+
+   public:
+    BranchTraceWriter(const std::string &path);
+    ~BranchTraceWriter();
+
+    void commit(const CommitRecord &record);
+};
+
+class BranchTraceReader : public BranchTrace {
+    std::ifstream in;
+
+   public:
+    BranchTraceReader(const std::string &path);
+
+    // 读到结尾记录时返回 false
+    bool next(BranchRecord &record);
+
+    // 已读过的记录覆盖的提交指令数，读完后为整个程序的指令数
+    uint64_t instructionCount() const { return instructions; }
+};
@@ -0,0 +1,71 @@
+#include <cstdint>
+#include <exception>
+#include <format>
+#include <iostream>
+#include <string>
+
+#include "trace.hpp"
+
+// 将二进制提交轨迹还原为文本。默认每条指令一行，只列出变化；
+// --regs 时按旧版 TRACE 的格式输出提交后的全部 32 个寄存器
+int main(int argc, char *argv[]) {
+    bool full_regs = false;
+    std::string path;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--regs") {
+            full_regs = true;
+        } else if (path.empty() && !arg.starts_with("--")) {
+            path = arg;
+        } else {
+            path.clear();
+            break;
+        }
+    }
+    if (path.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--regs] TRACE_FILE"
+                  << std::endl;
+        return 1;
+    }
+
+    try {
+        CommitTraceReader reader(path);
+        CommitRecord record;
+        size_t count = 0;
+        while (reader.next(record)) {
+            count++;
+            if (full_regs) {
+                std::cout << std::format("Commit PC: 0x{:08X}, regs: ",
+                                         record.PC);
+                for (int i = 0; i < 32; i++) {
+                    std::cout << std::format("0x{:08X} ", reader.reg(i));
+                }
+                std::cout << '\n';
+                continue;
+            }
+
+            std::cout << std::format("0x{:08X}: 0x{:08X}", record.PC,
+                                     record.instruction);
+            if (record.rd != 0) {
+                std::cout << std::format(" x{} = 0x{:08X}", record.rd,
+                                         record.value);
+            }
+            if (record.mem_type == CommitRecord::Load) {
+                std::cout << std::format(" load[0x{:08X}] mode {:03b}",
+                                         record.address, record.mode);
+            } else if (record.mem_type == CommitRecord::Store) {
+                std::cout << std::format(
+                    " store[0x{:08X}] = 0x{:08X} mode {:03b}", record.address,
+                    record.data, record.mode);
+            }
+            std::cout << '\n';
+        }
+        std::cerr << std::format("{} instructions committed.", count)
+                  << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,6 +1,55 @@
 #include "utils.hpp"
 
 #include <cstdint>
+#include <functional>
+#include <set>
+
+size_t wire_time = 1;
+
+#ifdef INSTRUMENT
+static std::set<const Probe *> &probes() {
+    static std::set<const Probe *> registered;
+    return registered;
+}
+
+Probe::Probe(Kind kind) : kind(kind), lookups(0), evaluations(0) {
+    probes().insert(this);
+}
+
+Probe::Probe(const Probe &other) : Probe(other.kind) {}
+
+Probe::~Probe() { probes().erase(this); }
+
+ProbeTotals &ProbeTotals::operator-=(const ProbeTotals &other) {
+    wires -= other.wires;
+    regs -= other.regs;
+    wire_lookups -= other.wire_lookups;
+    wire_evaluations -= other.wire_evaluations;
+    reg_pulls -= other.reg_pulls;
+    return *this;
+}
+
+ProbeTotals probeTotals(const void *begin, size_t size) {
+    const Probe *first = static_cast<const Probe *>(begin);
+    const Probe *last = reinterpret_cast<const Probe *>(
+        static_cast<const char *>(begin) + size);
+
+    ProbeTotals totals{};
+    for (auto it = probes().lower_bound(first);
+         it != probes().end() && std::less<const Probe *>()(*it, last);
+         ++it) {
+        if ((*it)->kind == Probe::WireProbe) {
+            totals.wires++;
+            totals.wire_lookups += (*it)->lookups;
+            totals.wire_evaluations += (*it)->evaluations;
+        } else {
+            totals.regs++;
+            totals.reg_pulls += (*it)->evaluations;
+        }
+    }
+    return totals;
+}
+#endif
 
 OpType get_opType(uint8_t op) {
     switch (op) {
@@ -111,13 +160,26 @@ bool get_variant_flag(uint32_t full_instruction) {
     return false;
 }
 
-ExecuteType getExecuteType(uint8_t op) {
+ExecuteType getExecuteType(uint32_t full_instruction) {
+    auto op = get_op(full_instruction);
     if (op == 0b0110111U /* lui */) {
         return None_T;
     }
     if (op == 0b0000011U /* lb, lh, lw, lbu, lhu */) {
         return Mem_T;
     }
+    if (op == 0b0110011U && (full_instruction >> 25) == 0b0000001U) {
+        // RV32M：mul, mulh, mulhsu, mulhu 与 div, divu, rem, remu
+        return get_subop(full_instruction) < 0b100 ? Mul_T : Div_T;
+    }
+    if (op == 0b1100011U /* branch */ || op == 0b1101111U /* jal */ ||
+        op == 0b1100111U /* jalr */) {
+        return Branch_T;
+    }
+    if ((op == 0b0010011U || op == 0b0110011U) &&
+        (get_subop(full_instruction) & 0b011U) == 0b001U) {
+        return Shift_T;  // sll, srl, sra 及其立即数形式
+    }
 
     return ALU_T;
 }
\ No newline at end of file
@@ -7,10 +7,41 @@
 
 extern size_t wire_time;
 
+#ifdef INSTRUMENT
+// 自剖析探针：每个 Wire/Reg 内嵌一个，记录被读取和求值的次数。
+// 所有探针按地址登记，统计时按部件的地址范围汇总
+struct Probe {
+    enum Kind { WireProbe, RegProbe } kind;
+    size_t lookups;      // Wire::value 调用次数
+    size_t evaluations;  // f 的调用次数（Wire 缓存未命中或 Reg::pull）
+
+    Probe(Kind kind);
+    Probe(const Probe &other);
+    Probe &operator=(const Probe &) { return *this; }
+    ~Probe();
+};
+
+struct ProbeTotals {
+    size_t wires;
+    size_t regs;
+    size_t wire_lookups;
+    size_t wire_evaluations;
+    size_t reg_pulls;
+
+    ProbeTotals &operator-=(const ProbeTotals &other);
+};
+
+// 汇总位于 [begin, begin + size) 内的全部探针
+ProbeTotals probeTotals(const void *begin, size_t size);
+#endif
+
 template <typename T>
 class Wire {
     T cache;
     size_t cache_time;
+#ifdef INSTRUMENT
+    Probe probe{Probe::WireProbe};
+#endif
 
    public:
     std::function<T(void)> f;
@@ -22,7 +53,13 @@ class Wire {
         return *this;
     }
     T value() {
+#ifdef INSTRUMENT
+        probe.lookups++;
+#endif
         if (cache_time == wire_time) return cache;
+#ifdef INSTRUMENT
+        probe.evaluations++;
+#endif
         cache_time = wire_time;
         return (cache = f());
     }
@@ -32,20 +69,32 @@ class Updatable {
    public:
     virtual void pull() = 0;
     virtual void update() = 0;
+    // 恢复到上电时的状态
+    virtual void reset() = 0;
 };
 
 template <typename T>
 class Reg : public Updatable {
     T value;
     T new_value;
+#ifdef INSTRUMENT
+    Probe probe{Probe::RegProbe};
+#endif
 
    public:
     std::function<T(void)> f;
     Reg(std::function<T(void)> f) : value(), new_value(), f(f) {}
     Reg() : Reg([]() { return T(); }) {}
     operator const T &() const { return value; }
-    void pull() { new_value = f(); }
+    void pull() {
+#ifdef INSTRUMENT
+        probe.evaluations++;
+#endif
+        new_value = f();
+    }
     void update() { value = new_value; }
+    void reset() { reset(T()); }
+    void reset(const T &initial) { value = new_value = initial; }
     Reg &operator<=(const std::function<T(void)> f) {
         this->f = f;
         return *this;
@@ -103,9 +152,7 @@ std::vector<T *> collectPointer(Args &&...args) {
     return result;
 }
 
-enum ExecuteType { None_T, ALU_T, Mem_T };
-
-ExecuteType getExecuteType(uint8_t op);
+ExecuteType getExecuteType(uint32_t full_instruction);
 
 struct PredictorStatistics {
     size_t total_branch;
@@ -118,4 +165,8 @@ struct MemoryStatistics {
     size_t total_read_count;
     size_t total_write_count;
     size_t read_cache_hit_count;
+    // 读缺失按 3C 分类，没有缓存时都为 0
+    size_t compulsory_miss_count;
+    size_t capacity_miss_count;
+    size_t conflict_miss_count;
 };
\ No newline at end of file